@@ -0,0 +1,188 @@
+#pragma once
+
+#include "binary_clifford_layer.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Q {
+
+	/// @brief State of a grouping run between two sweeps, from which the run can be continued with
+	///        the same result.
+	///
+	/// The graphs are not stored, only the seed they were generated from and a fingerprint to
+	/// check that the same graphs are used when resuming. The state of warm starts and of the
+	/// adaptive graph order is only present if these options are enabled.
+	struct GroupingCheckpoint {
+		static constexpr uint32_t noGraph = std::numeric_limits<uint32_t>::max(); // the edgeless graph
+
+		struct Collection {
+			std::vector<uint32_t> termIndices;
+			uint32_t graphIndex{ noGraph };
+			bool hasLayer{};
+			BinaryCliffordLayer layer;
+			uint64_t numGraphsEvaluated{};
+		};
+
+		uint64_t graphSeed{};
+		uint64_t numGraphs{};
+		uint64_t graphFingerprint{};
+		uint64_t numTerms{};
+		double elapsedSeconds{}; // time spent on the grouping so far
+		std::vector<uint64_t> activeTerms;
+		std::vector<Collection> collections;
+
+		std::vector<uint32_t> graphOrder;
+		std::vector<double> graphStatistics;
+		std::vector<std::vector<uint32_t>> previousMembers;
+		std::vector<BinaryCliffordLayer> previousWitnesses;
+
+		/// @brief Write the checkpoint to a temporary file which then replaces the given file, so
+		///        that the file always holds a complete checkpoint.
+		void save(const std::string& filename) const {
+			const auto temporary = filename + ".tmp";
+			{
+				std::ofstream file{ temporary, std::ios::binary };
+				if (!file) throw std::runtime_error("Could not open checkpoint file \"" + temporary + "\" for writing");
+				write(file, magic);
+				write(file, graphSeed);
+				write(file, numGraphs);
+				write(file, graphFingerprint);
+				write(file, numTerms);
+				write(file, elapsedSeconds);
+				writeVector(file, activeTerms);
+				write(file, static_cast<uint64_t>(collections.size()));
+				for (const auto& collection : collections) {
+					writeVector(file, collection.termIndices);
+					write(file, collection.graphIndex);
+					write(file, static_cast<uint8_t>(collection.hasLayer));
+					write(file, collection.layer);
+					write(file, collection.numGraphsEvaluated);
+				}
+				writeVector(file, graphOrder);
+				writeVector(file, graphStatistics);
+				write(file, static_cast<uint64_t>(previousMembers.size()));
+				for (const auto& members : previousMembers) writeVector(file, members);
+				writeVector(file, previousWitnesses);
+				file.close();
+				if (!file) throw std::runtime_error("Could not write checkpoint file \"" + temporary + "\"");
+			}
+			// Without flushing the file to the disk first, a crash shortly after the rename could 
+			// leave an empty or partial file in place of the previous checkpoint
+			syncToDisk(temporary);
+			std::filesystem::rename(temporary, filename);
+		}
+
+		/// @brief Read a checkpoint written by save()
+		static GroupingCheckpoint load(const std::string& filename) {
+			std::ifstream file{ filename, std::ios::binary };
+			if (!file) throw std::runtime_error("Could not open checkpoint file \"" + filename + "\"");
+			auto invalid = [&] { return std::runtime_error("Invalid checkpoint file \"" + filename + "\""); };
+			if (read<uint32_t>(file) != magic) throw invalid();
+
+			GroupingCheckpoint checkpoint;
+			checkpoint.graphSeed = read<uint64_t>(file);
+			checkpoint.numGraphs = read<uint64_t>(file);
+			checkpoint.graphFingerprint = read<uint64_t>(file);
+			checkpoint.numTerms = read<uint64_t>(file);
+			checkpoint.elapsedSeconds = read<double>(file);
+			readVector(file, checkpoint.activeTerms);
+			const auto numCollections = read<uint64_t>(file);
+			if (!file || checkpoint.activeTerms.size() != (checkpoint.numTerms + 63) / 64 || numCollections > checkpoint.numTerms + 1) throw invalid();
+			checkpoint.collections.resize(numCollections);
+			for (auto& collection : checkpoint.collections) {
+				readVector(file, collection.termIndices);
+				collection.graphIndex = read<uint32_t>(file);
+				collection.hasLayer = read<uint8_t>(file) != 0;
+				collection.layer = read<BinaryCliffordLayer>(file);
+				collection.numGraphsEvaluated = read<uint64_t>(file);
+				if (!file) throw invalid();
+			}
+			readVector(file, checkpoint.graphOrder);
+			readVector(file, checkpoint.graphStatistics);
+			const auto numPrevious = read<uint64_t>(file);
+			if (!file || numPrevious > checkpoint.numGraphs) throw invalid();
+			checkpoint.previousMembers.resize(numPrevious);
+			for (auto& members : checkpoint.previousMembers) readVector(file, members);
+			readVector(file, checkpoint.previousWitnesses);
+			if (!file) throw invalid();
+
+			// The indices are used to address terms and graphs, so they need to be in range. Each 
+			// grouped term is in exactly one collection and no longer active. 
+			auto isActive = [&](uint64_t index) { return (checkpoint.activeTerms[index / 64] >> (index % 64)) & 1; };
+			if (checkpoint.numTerms % 64 != 0 && checkpoint.activeTerms.back() >> (checkpoint.numTerms % 64) != 0) throw invalid();
+			std::vector<bool> grouped(checkpoint.numTerms);
+			for (const auto& collection : checkpoint.collections) {
+				if (collection.graphIndex != noGraph && collection.graphIndex >= checkpoint.numGraphs) throw invalid();
+				for (auto index : collection.termIndices) {
+					if (index >= checkpoint.numTerms || grouped[index] || isActive(index)) throw invalid();
+					grouped[index] = true;
+				}
+			}
+			for (const auto& members : checkpoint.previousMembers) {
+				if (std::ranges::any_of(members, [&](auto index) { return index >= checkpoint.numTerms; })) throw invalid();
+			}
+			if (std::ranges::any_of(checkpoint.graphOrder, [&](auto index) { return index >= checkpoint.numGraphs; })) throw invalid();
+			return checkpoint;
+		}
+
+	private:
+		static constexpr uint32_t magic = 0x50434748; // "HGCP"
+
+		static void syncToDisk(const std::string& filename) {
+#ifdef _WIN32
+			const int fd = _open(filename.c_str(), _O_WRONLY | _O_BINARY);
+			const bool synced = fd >= 0 && _commit(fd) == 0;
+			if (fd >= 0) _close(fd);
+#else
+			const int fd = ::open(filename.c_str(), O_WRONLY);
+			const bool synced = fd >= 0 && ::fsync(fd) == 0;
+			if (fd >= 0) ::close(fd);
+#endif
+			if (!synced) throw std::runtime_error("Could not write checkpoint file \"" + filename + "\" to disk");
+		}
+
+		template<class T>
+		static void write(std::ofstream& file, const T& value) {
+			file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template<class T>
+		static T read(std::ifstream& file) {
+			T value{};
+			file.read(reinterpret_cast<char*>(&value), sizeof(T));
+			return value;
+		}
+
+		template<class T>
+		static void writeVector(std::ofstream& file, const std::vector<T>& values) {
+			write(file, static_cast<uint64_t>(values.size()));
+			file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+		}
+
+		template<class T>
+		static void readVector(std::ifstream& file, std::vector<T>& values) {
+			const auto size = read<uint64_t>(file);
+			if (!file || size > (1ULL << 32)) {
+				file.setstate(std::ios::failbit);
+				return;
+			}
+			values.resize(size);
+			file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(size * sizeof(T)));
+		}
+	};
+
+}
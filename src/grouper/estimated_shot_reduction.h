@@ -1,39 +1,54 @@
 ﻿#pragma once
 
 #include <algorithm>
-#include "hamiltonian.h"
+#include "term_store.h"
+#include "pauli_grouper.h"
 
 
 namespace Q {
 
-	/// @brief Compute estimated shot reduction compared to single Pauli measurements. 
+	/// @brief Estimated shot reduction compared to single Pauli measurements, accumulated one 
+	///        collection at a time
 	/// 
 	///           ⎛  ∑_i^N ∑_j^{m_i} |a_ij|    ⎞²
 	/// \hat{R} = ⎜----------------------------⎟  
 	///	          ⎝ ∑_i^N √(∑_j^{m_i} |a_ij|²) ⎠
 	/// 
 	/// as defined in https://doi.org/10.22331/q-2021-01-20-385
-	/// 
-	/// @param hamiltonian Hamiltonian 
-	/// @param grouping    Grouping of the operators in hamiltonian
-	/// @return            Estimated shot reduction
-	double estimated_shot_reduction(const Hamiltonian& hamiltonian, const std::vector<CollectionWithGraph>& grouping) {
-		double numerator{};
-		double denominator{};
+	class ShotReductionEstimate {
+	public:
+		/// @param terms       Terms of the Hamiltonian, the collections need to hold indices into them
+		explicit ShotReductionEstimate(const TermStore& terms) : terms(terms) {}
 
-		for (const auto& group : grouping) {
+		void add(const CollectionWithGraph& group) {
 			double denominatorTerm{};
-			for (const auto& pauli : group.paulis) {
-				if (pauli == Pauli::Identity(hamiltonian.numQubits)) continue; // no need to measure identity
+			for (auto index : group.termIndices) {
+				if (terms.support(index) == 0) continue; // no need to measure identity
 
-				auto coefficient = std::get<double>(*std::ranges::find(hamiltonian.operators, pauli, [](const auto& a) { return std::get<0>(a); }));
-				double absolute = std::abs(coefficient);
+				double absolute = std::abs(terms.coefficient(index));
 				numerator += absolute;
 				denominatorTerm += absolute * absolute;
 			}
 			denominator += std::sqrt(denominatorTerm);
 		}
-		return numerator * numerator / (denominator * denominator);
+
+		double value() const { return numerator * numerator / (denominator * denominator); }
+
+	private:
+		const TermStore& terms;
+		double numerator{};
+		double denominator{};
+	};
+
+	/// @brief Compute estimated shot reduction of a grouping, see ShotReductionEstimate. 
+	/// 
+	/// @param terms       Terms of the Hamiltonian
+	/// @param grouping    Grouping of the terms, the collections need to hold indices into terms
+	/// @return            Estimated shot reduction
+	double estimated_shot_reduction(const TermStore& terms, const std::vector<CollectionWithGraph>& grouping) {
+		ShotReductionEstimate estimate{ terms };
+		for (const auto& group : grouping) estimate.add(group);
+		return estimate.value();
 	}
 
 }
@@ -0,0 +1,388 @@
+#include "graph_shards.h"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+
+using namespace Q;
+
+
+void Q::encode(MessageWriter& writer, const ShardSetup& setup) {
+	writer.u32(static_cast<uint32_t>(setup.numQubits));
+	writer.u64s(setup.xs);
+	writer.u64s(setup.zs);
+	writer.u64(setup.coefficients.size());
+	for (auto coefficient : setup.coefficients) writer.f64(coefficient);
+	writer.indices(setup.graphIds);
+	writer.u64(setup.graphs.size());
+	for (const auto& graph : setup.graphs) {
+		const auto edges = graph.getEdges();
+		writer.u64(edges.size());
+		for (auto [u, v] : edges) {
+			writer.u8(static_cast<uint8_t>(u));
+			writer.u8(static_cast<uint8_t>(v));
+		}
+	}
+	writer.u8(static_cast<uint8_t>(setup.options.solver));
+	writer.u64(setup.cacheSize);
+	writer.u8(setup.layerTables);
+	writer.u32(static_cast<uint32_t>(setup.options.numMainPaulis));
+	writer.u8(setup.options.warmStart);
+	writer.u8(setup.options.adaptiveGraphOrder);
+	writer.u64(setup.options.graphBudget.batchSize);
+	writer.u64(setup.options.graphBudget.maxBatchesWithoutImprovement);
+	writer.f64(setup.options.graphBudget.minImprovementProbability);
+}
+
+ShardSetup Q::decodeSetup(MessageReader& reader) {
+	auto invalid = [] { return std::runtime_error("Invalid setup message"); };
+	ShardSetup setup;
+	setup.numQubits = static_cast<int>(reader.u32());
+	if (setup.numQubits < 1 || setup.numQubits > 64) throw invalid();
+	setup.xs = reader.u64s();
+	setup.zs = reader.u64s();
+	setup.coefficients.resize(reader.u64());
+	for (auto& coefficient : setup.coefficients) coefficient = reader.f64();
+	if (setup.zs.size() != setup.xs.size() || setup.coefficients.size() != setup.xs.size()) throw invalid();
+	setup.graphIds = reader.indices();
+	const auto numGraphs = reader.u64();
+	if (numGraphs != setup.graphIds.size()) throw invalid();
+	for (size_t i = 0; i < numGraphs; ++i) {
+		auto& graph = setup.graphs.emplace_back(setup.numQubits);
+		const auto numEdges = reader.u64();
+		for (size_t k = 0; k < numEdges; ++k) {
+			const int u = reader.u8();
+			const int v = reader.u8();
+			if (u >= setup.numQubits || v >= setup.numQubits || u == v) throw invalid();
+			graph.addEdge(u, v);
+		}
+	}
+	const auto solver = reader.u8();
+	if (solver > static_cast<uint8_t>(HTSolver::Gurobi)) throw invalid();
+	setup.options.solver = static_cast<HTSolver>(solver);
+	setup.cacheSize = reader.u64();
+	setup.layerTables = reader.u8() != 0;
+	setup.options.numMainPaulis = static_cast<int>(reader.u32());
+	if (setup.options.numMainPaulis < 1) throw invalid();
+	setup.options.warmStart = reader.u8() != 0;
+	setup.options.adaptiveGraphOrder = reader.u8() != 0;
+	setup.options.graphBudget.batchSize = static_cast<size_t>(reader.u64());
+	setup.options.graphBudget.maxBatchesWithoutImprovement = static_cast<size_t>(reader.u64());
+	setup.options.graphBudget.minImprovementProbability = reader.f64();
+	return setup;
+}
+
+void Q::encode(MessageWriter& writer, const ShardSweep& sweep) {
+	writer.f64(sweep.secondsLeft);
+	writer.u64s(sweep.activeTerms);
+	writer.indices(sweep.mainIndices);
+	writer.u64s(sweep.minPriorities);
+}
+
+ShardSweep Q::decodeSweep(MessageReader& reader) {
+	ShardSweep sweep;
+	sweep.secondsLeft = reader.f64();
+	sweep.activeTerms = reader.u64s();
+	sweep.mainIndices = reader.indices();
+	sweep.minPriorities = reader.u64s();
+	if (sweep.minPriorities.size() != sweep.mainIndices.size()) throw std::runtime_error("Invalid sweep message");
+	return sweep;
+}
+
+void Q::encode(MessageWriter& writer, const ShardResult& result) {
+	writer.u64(result.numGraphsEvaluated);
+	writer.u64(result.bests.size());
+	for (const auto& best : result.bests) {
+		writer.u64(best.priority);
+		writer.u64(best.graphIndex);
+		writer.indices(best.termIndices);
+		for (auto bits : { best.witness.a, best.witness.b, best.witness.c, best.witness.d }) writer.u64(bits);
+	}
+}
+
+ShardResult Q::decodeResult(MessageReader& reader) {
+	ShardResult result;
+	result.numGraphsEvaluated = static_cast<size_t>(reader.u64());
+	result.bests.resize(reader.u64());
+	for (auto& best : result.bests) {
+		best.priority = reader.u64();
+		best.graphIndex = static_cast<size_t>(reader.u64());
+		best.termIndices = reader.indices();
+		for (auto* bits : { &best.witness.a, &best.witness.b, &best.witness.c, &best.witness.d }) *bits = reader.u64();
+	}
+	return result;
+}
+
+
+#ifndef _WIN32
+
+namespace {
+
+	sockaddr_un socketAddress(const std::string& address) {
+		sockaddr_un result{};
+		result.sun_family = AF_UNIX;
+		if (address.size() >= sizeof(result.sun_path)) throw std::runtime_error(std::format("The socket path \"{}\" is too long", address));
+		std::memcpy(result.sun_path, address.c_str(), address.size() + 1);
+		return result;
+	}
+
+	std::runtime_error systemError(const std::string& what) {
+		return std::runtime_error(std::format("{}: {}", what, std::strerror(errno)));
+	}
+
+	void writeAll(int socket, const uint8_t* data, size_t size) {
+#ifdef MSG_NOSIGNAL
+		constexpr int flags = MSG_NOSIGNAL;
+#else
+		constexpr int flags = 0;
+#endif
+		while (size > 0) {
+			const auto written = ::send(socket, data, size, flags);
+			if (written < 0 && errno == EINTR) continue;
+			if (written <= 0) throw systemError("Could not send to the other process");
+			data += written;
+			size -= static_cast<size_t>(written);
+		}
+	}
+
+	void readAll(int socket, uint8_t* data, size_t size) {
+		while (size > 0) {
+			const auto numRead = ::recv(socket, data, size, 0);
+			if (numRead < 0 && errno == EINTR) continue;
+			if (numRead == 0) throw std::runtime_error("The other process closed the connection");
+			if (numRead < 0) throw systemError("Could not receive from the other process");
+			data += numRead;
+			size -= static_cast<size_t>(numRead);
+		}
+	}
+
+}
+
+ShardConnection::~ShardConnection() {
+	if (socket >= 0) ::close(socket);
+}
+
+ShardConnection ShardConnection::connect(const std::string& address) {
+	const auto socketAddress = ::socketAddress(address);
+	ShardConnection connection{ ::socket(AF_UNIX, SOCK_STREAM, 0) };
+	if (connection.socket < 0) throw systemError("Could not create socket");
+	if (::connect(connection.socket, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0) {
+		throw systemError(std::format("Could not connect to \"{}\"", address));
+	}
+	return connection;
+}
+
+void ShardConnection::send(MessageType type, const MessageWriter& payload) {
+	MessageWriter header;
+	header.u32(static_cast<uint32_t>(type));
+	header.u64(payload.data().size());
+	writeAll(socket, header.data().data(), header.data().size());
+	writeAll(socket, payload.data().data(), payload.data().size());
+}
+
+ShardConnection::MessageType ShardConnection::receive(std::vector<uint8_t>& payload) {
+	std::vector<uint8_t> header(12);
+	readAll(socket, header.data(), header.size());
+	MessageReader reader{ header };
+	const auto type = static_cast<MessageType>(reader.u32());
+	payload.resize(reader.u64());
+	readAll(socket, payload.data(), payload.size());
+	if (type == MessageType::Error) {
+		MessageReader errorReader{ payload };
+		throw std::runtime_error(errorReader.string());
+	}
+	return type;
+}
+
+
+GraphShards::GraphShards(std::string address, int numWorkers, const std::string& workerCommand, int threadsPerWorker) : address(std::move(address)) {
+	try {
+		// Anyone who can connect to the socket could send results, so other users must not be able 
+		// to reach it. A temporary socket is created in a new directory that only the user can access. 
+		if (this->address.empty()) {
+			auto pattern = (std::filesystem::temp_directory_path() / "ht-grouper-XXXXXX").string();
+			if (::mkdtemp(pattern.data()) == nullptr) throw systemError("Could not create a directory for the socket");
+			directory = pattern;
+			this->address = (std::filesystem::path(directory) / "grouper.sock").string();
+		}
+		const auto socketAddress = ::socketAddress(this->address);
+		if (std::filesystem::is_socket(this->address)) std::filesystem::remove(this->address); // left over from an earlier run
+		listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0) throw systemError("Could not create socket");
+		if (::bind(listener, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0
+			|| ::chmod(this->address.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(listener, numWorkers) != 0) {
+			throw systemError(std::format("Could not listen on \"{}\"", this->address));
+		}
+
+		if (!workerCommand.empty()) {
+			const auto threads = std::to_string(threadsPerWorker);
+			for (int i = 0; i < numWorkers; ++i) {
+				const auto process = ::fork();
+				if (process < 0) throw systemError("Could not start worker process");
+				if (process == 0) {
+					::execl(workerCommand.c_str(), workerCommand.c_str(), "--worker", this->address.c_str(), threads.c_str(), nullptr);
+					::_exit(127);
+				}
+				processes.push_back(process);
+			}
+		}
+		else {
+			println("Waiting for {} workers to connect to \"{}\"", numWorkers, this->address);
+		}
+
+		// Spawned workers are checked while waiting, so that a worker that fails to start does not
+		// block the coordinator.
+		while (workers.size() < static_cast<size_t>(numWorkers)) {
+			pollfd request{ listener, POLLIN, 0 };
+			const auto ready = ::poll(&request, 1, 1000);
+			if (ready < 0 && errno != EINTR) throw systemError("Could not wait for workers");
+			if (ready <= 0) {
+				for (auto process : processes) {
+					if (::waitpid(process, nullptr, WNOHANG) == process) throw std::runtime_error("A worker process exited before connecting");
+				}
+				continue;
+			}
+			ShardConnection worker{ ::accept(listener, nullptr, nullptr) };
+			std::vector<uint8_t> payload;
+			if (worker.receive(payload) != ShardConnection::MessageType::Hello) throw std::runtime_error("Unexpected message from worker");
+			MessageReader reader{ payload };
+			if (reader.u32() != ShardConnection::version) throw std::runtime_error("A worker uses a different protocol version");
+			const auto numThreads = reader.u32();
+			println("Worker {} connected ({} threads)", workers.size(), numThreads);
+			workers.push_back(std::move(worker));
+		}
+	}
+	catch (...) {
+		close();
+		throw;
+	}
+}
+
+GraphShards::~GraphShards() {
+	close();
+}
+
+void GraphShards::close() {
+	for (auto& worker : workers) {
+		try {
+			worker.send(ShardConnection::MessageType::Shutdown);
+		}
+		catch (...) {}
+	}
+	workers.clear();
+	if (listener >= 0) {
+		::close(listener);
+		listener = -1;
+		std::error_code error;
+		std::filesystem::remove(address, error);
+	}
+	if (!directory.empty()) {
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+		directory.clear();
+	}
+	// Workers that have not connected yet see the closed socket and exit
+	for (auto process : processes) ::waitpid(process, nullptr, 0);
+	processes.clear();
+}
+
+#else
+
+ShardConnection::~ShardConnection() = default;
+
+ShardConnection ShardConnection::connect(const std::string&) {
+	throw std::runtime_error("Worker processes are only supported on POSIX systems");
+}
+
+void ShardConnection::send(MessageType, const MessageWriter&) {}
+
+ShardConnection::MessageType ShardConnection::receive(std::vector<uint8_t>&) {
+	return MessageType::Shutdown;
+}
+
+GraphShards::GraphShards(std::string, int, const std::string&, int) {
+	throw std::runtime_error("Worker processes are only supported on POSIX systems");
+}
+
+GraphShards::~GraphShards() = default;
+
+void GraphShards::close() {}
+
+#endif
+
+
+void GraphShards::start(const ShardSetup& setup, const std::vector<Graph<>>& graphs) {
+	numGraphs = graphs.size();
+	for (size_t w = 0; w < workers.size(); ++w) {
+		auto shard = setup;
+		shard.graphIds.clear();
+		shard.graphs.clear();
+		for (auto i = w; i < graphs.size(); i += workers.size()) {
+			shard.graphIds.push_back(i);
+			shard.graphs.push_back(graphs[i]);
+		}
+		MessageWriter writer;
+		encode(writer, shard);
+		workers[w].send(ShardConnection::MessageType::Setup, writer);
+	}
+}
+
+ShardResult GraphShards::evaluate(const ShardSweep& sweep) {
+	MessageWriter writer;
+	encode(writer, sweep);
+	for (auto& worker : workers) worker.send(ShardConnection::MessageType::Sweep, writer);
+
+	// Collections are compared by their priority, which includes the index of the graph in
+	// the full list, so the best collection is the same as without shards.
+	ShardResult result;
+	result.bests.resize(sweep.mainIndices.size());
+	std::vector<uint8_t> payload;
+	for (size_t w = 0; w < workers.size(); ++w) {
+		try {
+			if (workers[w].receive(payload) != ShardConnection::MessageType::Result) throw std::runtime_error("Unexpected message");
+			MessageReader reader{ payload };
+			auto shardResult = decodeResult(reader);
+			if (shardResult.bests.size() != result.bests.size()) throw std::runtime_error("Invalid result message");
+			for (size_t j = 0; j < result.bests.size(); ++j) {
+				if (!isValidResult(shardResult.bests[j], sweep, sweep.mainIndices[j], w)) throw std::runtime_error("Invalid collection in result message");
+			}
+			result.numGraphsEvaluated += shardResult.numGraphsEvaluated;
+			for (size_t j = 0; j < result.bests.size(); ++j) {
+				if (shardResult.bests[j].priority > result.bests[j].priority) result.bests[j] = std::move(shardResult.bests[j]);
+			}
+		}
+		catch (std::exception& e) {
+			throw std::runtime_error(std::format("Worker {}: {}", w, e.what()));
+		}
+	}
+	return result;
+}
+
+bool GraphShards::isValidResult(const BestCollection& best, const ShardSweep& sweep, size_t mainIndex, size_t worker) const {
+	if (best.priority == 0) return true; // no collection
+	if (best.graphIndex >= numGraphs || best.graphIndex % workers.size() != worker) return false;
+	if (best.priority != BestCollection::makePriority(best.termIndices.size(), best.graphIndex + 1)) return false;
+
+	// The terms need to be remaining terms, each at most once, and include the main Pauli
+	auto terms = sweep.activeTerms;
+	for (auto index : best.termIndices) {
+		if (index / 64 >= terms.size() || !((terms[index / 64] >> (index % 64)) & 1)) return false;
+		terms[index / 64] &= ~(1ULL << (index % 64));
+	}
+	return std::ranges::find(best.termIndices, mainIndex) != best.termIndices.end();
+}
+
+void GraphShards::finish() {
+	for (auto& worker : workers) worker.send(ShardConnection::MessageType::Finish);
+}
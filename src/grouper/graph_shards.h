@@ -0,0 +1,225 @@
+#pragma once
+
+#include "pauli_grouper.h"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Q {
+
+	/// @brief Best collection found for a main Pauli, as term indices together with the index of
+	///        the graph and the layer that diagonalizes the collection. A priority of 0 means that
+	///        no graph gave a collection with a higher priority than requested.
+	struct BestCollection {
+		uint64_t priority{};
+		size_t graphIndex{};
+		std::vector<size_t> termIndices;
+		BinaryCliffordLayer witness;
+
+		/// @brief Priority of a collection: larger collections first, then the TPB collection (order 0)
+		///        and then the graphs in the given order (order = graph index + 1).
+		static uint64_t makePriority(size_t size, size_t order) { return (static_cast<uint64_t>(size) << 32) | (0xFFFFFFFFULL - order); }
+	};
+
+	/// @brief Everything a worker needs to evaluate its shard of the graphs
+	struct ShardSetup {
+		int numQubits{};
+		std::vector<uint64_t> xs;          // terms in the order of the TermStore of the coordinator
+		std::vector<uint64_t> zs;
+		std::vector<double> coefficients;
+		std::vector<size_t> graphIds;      // index of each graph of the shard in the full list of graphs
+		std::vector<Graph<>> graphs;
+		GrouperOptions options;            // the caches, time budget and verbose are not sent, the graph budget is applied to each shard
+		uint64_t cacheSize{};              // in bytes, 0 disables the feasibility cache
+		bool layerTables{};
+	};
+
+	/// @brief Main Paulis of a sweep together with the remaining terms
+	struct ShardSweep {
+		double secondsLeft{};              // time left for evaluating graphs, 0 for no limit
+		std::vector<uint64_t> activeTerms;
+		std::vector<size_t> mainIndices;
+		std::vector<uint64_t> minPriorities; // priority a collection needs to beat for each main Pauli
+	};
+
+	/// @brief Best collections of a shard for the main Paulis of a sweep
+	struct ShardResult {
+		size_t numGraphsEvaluated{};
+		std::vector<BestCollection> bests;
+	};
+
+
+	/// @brief Messages are encoded as a sequence of fixed-width little-endian values, so that the
+	///        encoding does not depend on the machine at either end of the connection.
+	class MessageWriter {
+	public:
+		void u8(uint8_t value) { bytes.push_back(value); }
+		void u32(uint32_t value) { put(value, 4); }
+		void u64(uint64_t value) { put(value, 8); }
+		void f64(double value) { put(std::bit_cast<uint64_t>(value), 8); }
+
+		void u64s(const std::vector<uint64_t>& values) {
+			u64(values.size());
+			for (auto value : values) u64(value);
+		}
+		void indices(const std::vector<size_t>& values) {
+			u64(values.size());
+			for (auto value : values) u64(value);
+		}
+		void string(const std::string& value) {
+			u64(value.size());
+			bytes.insert(bytes.end(), value.begin(), value.end());
+		}
+
+		const std::vector<uint8_t>& data() const { return bytes; }
+
+	private:
+		std::vector<uint8_t> bytes;
+
+		void put(uint64_t value, int numBytes) {
+			for (int i = 0; i < numBytes; ++i) bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+	};
+
+	class MessageReader {
+	public:
+		explicit MessageReader(const std::vector<uint8_t>& bytes) : bytes(bytes) {}
+
+		uint8_t u8() { return static_cast<uint8_t>(get(1)); }
+		uint32_t u32() { return static_cast<uint32_t>(get(4)); }
+		uint64_t u64() { return get(8); }
+		double f64() { return std::bit_cast<double>(get(8)); }
+
+		std::vector<uint64_t> u64s() {
+			std::vector<uint64_t> values(length(8));
+			for (auto& value : values) value = u64();
+			return values;
+		}
+		std::vector<size_t> indices() {
+			std::vector<size_t> values(length(8));
+			for (auto& value : values) value = static_cast<size_t>(u64());
+			return values;
+		}
+		std::string string() {
+			const auto size = length(1);
+			std::string value(reinterpret_cast<const char*>(bytes.data() + position), size);
+			position += size;
+			return value;
+		}
+
+	private:
+		const std::vector<uint8_t>& bytes;
+		size_t position{};
+
+		uint64_t get(size_t numBytes) {
+			if (bytes.size() - position < numBytes) throw std::runtime_error("Truncated message");
+			uint64_t value{};
+			for (size_t i = 0; i < numBytes; ++i) value |= static_cast<uint64_t>(bytes[position++]) << (8 * i);
+			return value;
+		}
+
+		/// Read the length of an array and check that the message can hold it
+		size_t length(size_t elementSize) {
+			const auto size = u64();
+			if (size > (bytes.size() - position) / elementSize) throw std::runtime_error("Truncated message");
+			return static_cast<size_t>(size);
+		}
+	};
+
+	void encode(MessageWriter& writer, const ShardSetup& setup);
+	void encode(MessageWriter& writer, const ShardSweep& sweep);
+	void encode(MessageWriter& writer, const ShardResult& result);
+	ShardSetup decodeSetup(MessageReader& reader);
+	ShardSweep decodeSweep(MessageReader& reader);
+	ShardResult decodeResult(MessageReader& reader);
+
+
+	/// @brief Framed messages over a stream socket. Each message has a type and a payload.
+	///
+	/// The protocol only needs a reliable byte stream, the local Unix-domain sockets used now
+	/// could be replaced by TCP connections to other machines.
+	class ShardConnection {
+	public:
+		enum class MessageType : uint32_t { Hello = 1, Setup, Sweep, Result, Finish, Shutdown, Error };
+
+		/// Protocol version sent by the worker in its Hello message
+		static constexpr uint32_t version = 1;
+
+		ShardConnection() = default;
+		explicit ShardConnection(int socket) : socket(socket) {}
+		ShardConnection(ShardConnection&& other) noexcept : socket(std::exchange(other.socket, -1)) {}
+		ShardConnection& operator=(ShardConnection&& other) noexcept {
+			std::swap(socket, other.socket);
+			return *this;
+		}
+		~ShardConnection();
+
+		/// @brief Connect to a coordinator listening on the Unix-domain socket at the given path
+		static ShardConnection connect(const std::string& address);
+
+		void send(MessageType type, const MessageWriter& payload = {});
+		/// @brief Wait for the next message. An Error message is thrown as std::runtime_error.
+		MessageType receive(std::vector<uint8_t>& payload);
+
+	private:
+		int socket{ -1 };
+	};
+
+
+	/// @brief Coordinator side of the worker processes. Each worker evaluates a shard of the graphs
+	///        for each sweep and sends back its best collection for each main Pauli, of which the
+	///        grouper commits the best as it would for its own graphs.
+	class GraphShards {
+	public:
+		/// @brief Listen on a Unix-domain socket and wait until the given number of workers have connected.
+		/// @param address         Path of the socket, empty for a path in a new temporary directory that only 
+		///                        the user can access. The socket itself is only accessible by the user. 
+		/// @param numWorkers      Number of workers
+		/// @param workerCommand   If not empty, the workers are started on this machine by running this
+		///                        executable with the arguments "--worker <address> <threadsPerWorker>".
+		///                        Otherwise they need to be started separately.
+		GraphShards(std::string address, int numWorkers, const std::string& workerCommand = {}, int threadsPerWorker = 1);
+		GraphShards(const GraphShards&) = delete;
+		GraphShards& operator=(const GraphShards&) = delete;
+		/// @brief Shut down the workers and remove the socket
+		~GraphShards();
+
+		size_t size() const { return workers.size(); }
+
+		/// @brief Start a grouping: the graphs are dealt out to the workers in turn, so that each
+		///        shard gets a similar mix of small and large graphs.
+		/// @param setup  Terms and settings, the graphs are taken from the next argument
+		void start(const ShardSetup& setup, const std::vector<Graph<>>& graphs);
+
+		/// @brief Evaluate a sweep on all shards. The result holds the best collection over all
+		///        shards for each main Pauli and the total number of evaluated graphs. Results that
+		///        could not have come from the shard of a worker are rejected with an exception. 
+		ShardResult evaluate(const ShardSweep& sweep);
+
+		/// @brief End the grouping, the workers then wait for the next one
+		void finish();
+
+	private:
+		std::string address;
+		std::string directory;      // temporary directory of the socket, empty if the address was given
+		size_t numGraphs{};         // number of graphs of the current grouping
+		int listener{ -1 };
+		std::vector<ShardConnection> workers;
+		std::vector<int> processes; // ids of the spawned workers
+
+		void close();
+
+		/// @brief Check that a collection of the given worker is made of remaining terms and comes 
+		///        from a graph of its shard
+		bool isValidResult(const BestCollection& best, const ShardSweep& sweep, size_t mainIndex, size_t worker) const;
+	};
+
+	/// @brief Serve a coordinator as a worker until it shuts down: evaluate the shard of the graphs
+	///        of each grouping for its sweeps (implemented in pauli_grouper.cpp).
+	void runShardWorker(ShardConnection& connection, int numThreads);
+
+}
@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include <format>
 #include "graph.h"
+#include "term_store.h"
 
 namespace JsonFormatting {
 
@@ -22,12 +23,12 @@ namespace JsonFormatting {
 	}
 
 
-	void printPauliCollection(auto out, const auto& collection) {
+	void printPauliCollection(auto out, const auto& collection, const Q::TermStore& terms) {
 		std::format_to(out, "    {{\n      \"operators\": [");
 
-		for (size_t i = 0; i < collection.paulis.size(); ++i) {
-			std::format_to(out, "\"{}\"", collection.paulis[i]);
-			if (i != collection.paulis.size() - 1) {
+		for (size_t i = 0; i < collection.termIndices.size(); ++i) {
+			std::format_to(out, "\"{}\"", terms.pauli(collection.termIndices[i]));
+			if (i != collection.termIndices.size() - 1) {
 				std::format_to(out, ",");
 			}
 		}
@@ -47,31 +48,47 @@ namespace JsonFormatting {
 				std::format_to(out, ",");
 			}
 		}
-		std::format_to(out, "]\n    }}");
+		std::format_to(out, "],\n      \"graphs evaluated\": {}\n    }}", collection.numGraphsEvaluated);
 	}
 
 
-	void printPauliCollections(auto out, const auto& collections, const MetaInfo& metaInfo) {
-
-		std::format_to(out, "{{\n");
-		std::format_to(out, "  \"runtime [seconds]\": {},\n", metaInfo.timeInSeconds);
-		std::format_to(out, "  \"num graphs\": {},\n", metaInfo.numGraphs);
-		std::format_to(out, "  \"connectivity\": [");
-		printEdgeList(out, metaInfo.connectivity.getEdges());
-		std::format_to(out, "],\n", metaInfo.numGraphs);
-		std::format_to(out, "  \"random seed\": {},\n", metaInfo.randomSeed);
+	/// @brief Prints the collections of a grouping one at a time, so that they do not need to be 
+	///        kept until the grouping is done. The meta info follows the grouping, as the run time 
+	///        is only known at the end. 
+	template<class Out>
+	class PauliCollectionPrinter {
+	public:
+		PauliCollectionPrinter(Out out, const Q::TermStore& terms) : out(out), terms(terms) {
+			std::format_to(out, "{{\n  \"grouping\": [\n");
+		}
 
-		//auto mat = metaInfo.connectivity.getAdjacencyMatrix();
-		//for(int i=0; i < )
+		void print(const auto& collection) {
+			if (numCollections++ != 0) std::format_to(out, ",\n");
+			printPauliCollection(out, collection, terms);
+		}
 
-		std::format_to(out, "  \"grouping\": [\n");
-		for (size_t i = 0; i < collections.size(); ++i) {
-			printPauliCollection(out, collections[i]);
-			if (i != collections.size() - 1) {
-				std::format_to(out, ",\n");
-			}
+		void finish(const MetaInfo& metaInfo) {
+			std::format_to(out, "\n  ],\n");
+			std::format_to(out, "  \"runtime [seconds]\": {},\n", metaInfo.timeInSeconds);
+			std::format_to(out, "  \"num graphs\": {},\n", metaInfo.numGraphs);
+			std::format_to(out, "  \"connectivity\": [");
+			printEdgeList(out, metaInfo.connectivity.getEdges());
+			std::format_to(out, "],\n");
+			std::format_to(out, "  \"random seed\": {}\n}}\n", metaInfo.randomSeed);
 		}
-		std::format_to(out, "\n  ]\n}}\n");
+
+		size_t size() const { return numCollections; }
+
+	private:
+		Out out;
+		const Q::TermStore& terms;
+		size_t numCollections{};
+	};
+
+	void printPauliCollections(auto out, const auto& collections, const Q::TermStore& terms, const MetaInfo& metaInfo) {
+		PauliCollectionPrinter printer{ out, terms };
+		for (const auto& collection : collections) printer.print(collection);
+		printer.finish(metaInfo);
 	}
 
 
@@ -1,6 +1,7 @@
 ﻿
 #include "read_hamiltonians.h"
 #include "pauli_grouper.h"
+#include "graph_shards.h"
 #include "json_formatting.h"
 #include "estimated_shot_reduction.h"
 #include "data_path.h"
@@ -8,6 +9,9 @@
 #include <random>
 #include <chrono>
 #include <filesystem>
+#include <memory>
+#include <optional>
+#include <thread>
 
 using namespace Q;
 
@@ -24,7 +28,7 @@ auto getRandomSubgraphs(const Graph<>& graph, int64_t num, int maxEdgeCount, RNG
 	const auto edgeCount = graph.edgeCount();
 	if (edgeCount <= 63) {
 		// Check if num wanted graphs is greater or equal the total number of subgraphs
-		// then we just return all subgraphs 
+		// then we just return all subgraphs (in the order they are generated, without drawing from rng)
 		const uint64_t totalNumSubgraphs = 1ULL << edgeCount;
 		if (num >= totalNumSubgraphs) {
 			return generateSubgraphs(graph, 0, maxEdgeCount);
@@ -54,7 +58,21 @@ auto getRandomSubgraphs(const Graph<>& graph, int64_t num, int maxEdgeCount, RNG
 }
 
 
-int main() {
+int main(int argc, char* argv[]) {
+	// Worker process: grouper --worker <socket> [numThreads]
+	if (argc >= 3 && std::string_view{ argv[1] } == "--worker") {
+		try {
+			const int numThreads = argc >= 4 ? std::stoi(argv[3]) : static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+			auto connection = ShardConnection::connect(argv[2]);
+			runShardWorker(connection, numThreads);
+		}
+		catch (std::exception& e) {
+			println("Worker: {}", e.what());
+			return 1;
+		}
+		return 0;
+	}
+
 	try {
 
 		Configuration config = readConfig(DATA_PATH "config.txt");
@@ -66,12 +84,32 @@ int main() {
   maxEdgeCount = {}
   numGraphs = {}
   sortGraphsByEdgeCount = {}
-)", config.filename, config.outfilename, config.connectivity, config.numThreads, config.maxEdgeCount, config.numGraphs, config.sortGraphsByEdgeCount);
+  solver = {}
+  cacheSize = {} MB
+  layerTables = {}
+  numMainPaulis = {}
+  warmStart = {}
+  timeBudget = {} s
+  graphBatchSize = {}
+  maxBatchesWithoutImprovement = {}
+  minImprovementProbability = {}
+  adaptiveGraphOrder = {}
+  checkpointFile = {}
+  checkpointInterval = {}
+  checkpointSeconds = {} s
+  resume = {}
+  numWorkers = {}
+  workerSocket = {}
+  blockSize = {}
+  chunkMemoryLimit = {} MB
+  reportChunkingLoss = {}
+)", config.filename, config.outfilename, config.connectivity, config.numThreads, config.maxEdgeCount, config.numGraphs, config.sortGraphsByEdgeCount,
+			config.solver == HTSolver::Native ? "native" : config.solver == HTSolver::Gurobi ? "gurobi" : "auto", config.cacheSize, config.layerTables, config.numMainPaulis, config.warmStart, config.timeBudget,
+			config.graphBatchSize, config.maxBatchesWithoutImprovement, config.minImprovementProbability, config.adaptiveGraphOrder,
+			config.checkpointFile, config.checkpointInterval, config.checkpointSeconds, config.resume, config.numWorkers, config.workerSocket, config.blockSize,
+			config.chunkMemoryLimit, config.reportChunkingLoss);
 
 
-		using clock = std::chrono::high_resolution_clock;
-		const auto t0 = clock::now();
-
 		// Read a hamiltonian consisting of Paulis together with weightings
 		// and find a grouping into simultaneously measurable sets respecting
 		// a given hardware connectivity. 
@@ -82,6 +120,7 @@ int main() {
 
 		const auto hamiltonian = readHamiltonianFromJson(filename);
 		const auto numQubits = hamiltonian.numQubits;
+		const TermStore terms{ hamiltonian };
 
 		Connectivity connectivitySpec = readConnectivity(connectivityFile);
 		const auto connectivity = connectivitySpec.getGraph(numQubits);
@@ -108,43 +147,199 @@ int main() {
 
 		
 
-		const auto seed = config.seed == 0 ? std::random_device{}() : config.seed;
-		std::mt19937_64 randomGenerator{ seed };
-		//decltype(subgraphs) selectedGraphs;
-		//std::sample(subgraphs.begin(), subgraphs.end(), std::back_inserter(selectedGraphs), config.numGraphs, randomGenerator);
-		auto selectedGraphs = getRandomSubgraphs(connectivity, config.numGraphs, config.maxEdgeCount, randomGenerator);
+		// With several values for numGraphs, each value gets its own output and checkpoint file
+		auto fileForPoint = [&](const std::string& filename, int64_t numGraphs) {
+			auto path = std::filesystem::path(filename);
+			if (config.numGraphs.size() > 1) {
+				path.replace_filename(std::format("{}_{}_subgraphs{}", path.stem().string(), numGraphs, path.extension().string()));
+			}
+			return path.string();
+		};
+
+		// A resumed run continues from the checkpoints that exist and takes the seed from them
+		std::vector<std::optional<GroupingCheckpoint>> checkpoints(config.numGraphs.size());
+		uint64_t checkpointSeed{};
+		if (config.resume) {
+			for (size_t point = 0; point < config.numGraphs.size(); ++point) {
+				const auto checkpointFile = fileForPoint(toAbsolutePath(config.checkpointFile), config.numGraphs[point]);
+				if (!std::filesystem::exists(checkpointFile)) continue;
+				checkpoints[point] = GroupingCheckpoint::load(checkpointFile);
+				if (checkpointSeed == 0) checkpointSeed = checkpoints[point]->graphSeed;
+				println("Resuming from checkpoint \"{}\" with {} groups", checkpointFile, checkpoints[point]->collections.size());
+			}
+		}
+		const uint64_t seed = config.seed != 0 ? config.seed : checkpointSeed != 0 ? checkpointSeed : std::random_device{}();
+		if (config.blockSize > 0) println("Running HT Pauli grouper with {} Paulis on {} qubits in blocks of {} qubits", hamiltonian.operators.size(), numQubits, config.blockSize);
+		else {
+			std::string numGraphsList;
+			for (const auto numGraphs : config.numGraphs) numGraphsList += std::format("{}{}", numGraphsList.empty() ? "" : ", ", numGraphs);
+			println("Running HT Pauli grouper with {} Paulis and {} Graphs on {} qubits", hamiltonian.operators.size(), numGraphsList, numQubits);
+		}
+		println("Random seed: {}\n", seed);
+		auto cache = config.cacheSize > 0 ? std::make_unique<HTFeasibilityCache>(static_cast<size_t>(config.cacheSize) << 20) : nullptr;
+		auto layerTables = config.layerTables ? std::make_unique<HTLayerTables>() : nullptr;
+		const auto layerTableFile = config.layerTableFile.empty() ? std::string{} : toAbsolutePath(config.layerTableFile);
+		if (layerTables && !layerTableFile.empty() && std::filesystem::exists(layerTableFile)) {
+			layerTables->load(layerTableFile);
+		}
+		const auto numLoadedLayerTables = layerTables ? layerTables->size() : 0;
+
+		GrouperOptions grouperOptions;
+		grouperOptions.solver = config.solver;
+		grouperOptions.cache = cache.get();
+		grouperOptions.layerTables = layerTables.get();
+		grouperOptions.numMainPaulis = static_cast<int>(config.numMainPaulis);
+		grouperOptions.warmStart = config.warmStart;
+		grouperOptions.timeBudget = static_cast<double>(config.timeBudget);
+		grouperOptions.graphBudget = { static_cast<size_t>(config.graphBatchSize), static_cast<size_t>(config.maxBatchesWithoutImprovement), config.minImprovementProbability };
+		grouperOptions.adaptiveGraphOrder = config.adaptiveGraphOrder;
+
+		// Without a socket path, the workers are started on this machine with numThreads threads each
+		std::unique_ptr<GraphShards> shards;
+		if (config.numWorkers > 0) {
+			const auto executable = std::filesystem::exists("/proc/self/exe") ? std::filesystem::read_symlink("/proc/self/exe").string() : std::string{ argv[0] };
+			shards = std::make_unique<GraphShards>(config.workerSocket, static_cast<int>(config.numWorkers), config.workerSocket.empty() ? executable : std::string{}, static_cast<int>(config.numThreads));
+		}
+
+		// The anticommutation matrix grows with the square of the number of terms, so with a limit on 
+		// its memory the terms may need to be grouped in chunks. The feasibility cache takes its share 
+		// of the limit first (the configuration keeps it below the limit). 
+		const auto chunkSize = config.chunkMemoryLimit > 0 ? maxChunkSize(static_cast<size_t>(config.chunkMemoryLimit - config.cacheSize) << 20) : terms.size();
+		const bool chunked = chunkSize < terms.size();
+		if (chunked) println("Grouping the terms in chunks of {} terms to keep the cache and the anticommutation matrix within {} MB\n", chunkSize, config.chunkMemoryLimit);
+
+		using clock = std::chrono::high_resolution_clock;
 
-		if (config.sortGraphsByEdgeCount) {
-			std::ranges::sort(selectedGraphs, std::less{}, &Graph<>::edgeCount);
+		// The baseline groupings are computed once and timed separately from the HT grouping. Only 
+		// their shot reductions are kept, the groupings are freed before the HT grouping starts. 
+		double R_hat_tpb{};
+		double R_hat_si{};
+		int64_t siTimeInSeconds{};
+		{
+			const auto tpbStart = clock::now();
+			println("Running TPB grouping");
+			const auto tpbGrouping = applyTPBGrouper(terms, config.numThreads, false);
+			R_hat_tpb = estimated_shot_reduction(terms, tpbGrouping);
+			println("Found TPB grouping into {} subsets, run time: {}s", tpbGrouping.size(), std::chrono::duration_cast<std::chrono::seconds>(clock::now() - tpbStart).count());
+		}
+		{
+			const auto siStart = clock::now();
+			println("Running Sorted Insertion with general commutativity");
+			const auto siGrouping = applySortedInsertion(terms, config.numThreads);
+			R_hat_si = estimated_shot_reduction(terms, siGrouping);
+			siTimeInSeconds = std::chrono::duration_cast<std::chrono::seconds>(clock::now() - siStart).count();
+			println("Found Sorted Insertion grouping into {} subsets, run time: {}s\n", siGrouping.size(), siTimeInSeconds);
 		}
 
-		println("Running HT Pauli grouper with {} Paulis and {} Graphs on {} qubits", hamiltonian.operators.size(), selectedGraphs.size(), numQubits);
-		println("Random seed: {}\n", seed);
-		auto htGrouping = applyPauliGrouper2Multithread2(hamiltonian, selectedGraphs, config.numThreads, config.extractComputationalBasis);
-		
-		
-		println("\n\n\n---------------\nRunning TPB grouping", hamiltonian.operators.size(), selectedGraphs.size(), numQubits);
-		auto tpbGrouping = applyPauliGrouper2Multithread2(hamiltonian, { Graph<>(numQubits) }, config.numThreads, false);
+		// With several values for numGraphs, a grouping is computed for each of them. The graphs are 
+		// drawn from the same random stream every time, so the graphs of each value are a subset of 
+		// the graphs of the next one and each grouping is the same as in a separate run. They are a 
+		// prefix unless they are sorted by edge count or the next value covers all subgraphs, which 
+		// getRandomSubgraphs() then returns in the order they are generated. The feasibility cache, 
+		// the layer tables and the baseline groupings are shared. The run time of each value only 
+		// covers its own grouping. 
+		struct SweepPoint {
+			size_t numGraphs{};
+			size_t numGroups{};
+			double R_hat_HT{};
+			int64_t timeInSeconds{};
+		};
+		std::vector<SweepPoint> sweepPoints;
+
+		for (size_t point = 0; point < config.numGraphs.size(); ++point) {
+			const auto numGraphs = config.numGraphs[point];
+			const auto pointStart = clock::now();
+
+			std::mt19937_64 randomGenerator{ seed };
+			//decltype(subgraphs) selectedGraphs;
+			//std::sample(subgraphs.begin(), subgraphs.end(), std::back_inserter(selectedGraphs), config.numGraphs, randomGenerator);
+			// The block grouper draws no random graphs, it uses all subgraphs of each block
+			auto selectedGraphs = config.blockSize > 0 ? std::vector<Graph<>>{} : getRandomSubgraphs(connectivity, numGraphs, config.maxEdgeCount, randomGenerator);
+
+			if (config.sortGraphsByEdgeCount) {
+				std::ranges::sort(selectedGraphs, std::less{}, &Graph<>::edgeCount);
+			}
+			if (config.numGraphs.size() > 1) {
+				println("\n\n\n---------------\nRunning HT Pauli grouper with {} Graphs", selectedGraphs.size());
+			}
 
-		//htGrouping.erase(htGrouping.begin(), htGrouping.begin() + 2);
-		//tpbGrouping.erase(tpbGrouping.begin(), tpbGrouping.begin() + 2);
+			// Group the given terms with the configured grouper, the computational basis and the 
+			// checkpoints only for the full set of terms
+			auto groupTerms = [&](TermStore termsToGroup, double timeBudget, bool whole, bool verbose) {
+				auto options = grouperOptions;
+				options.timeBudget = timeBudget;
+				options.verbose = verbose;
+				if (config.blockSize > 0) {
+					return applyBlockGrouper(termsToGroup, connectivity, static_cast<int>(config.blockSize), static_cast<int>(config.maxEdgeCount), config.numThreads, whole && config.extractComputationalBasis, options);
+				}
+				CheckpointSettings checkpoint;
+				if (whole) {
+					checkpoint.filename = config.checkpointFile.empty() ? std::string{} : fileForPoint(toAbsolutePath(config.checkpointFile), numGraphs);
+					checkpoint.interval = static_cast<size_t>(config.checkpointInterval);
+					checkpoint.intervalSeconds = static_cast<double>(config.checkpointSeconds);
+					checkpoint.graphSeed = seed;
+					checkpoint.resumeFrom = checkpoints[point] ? &*checkpoints[point] : nullptr;
+				}
+				return applyPauliGrouper2Multithread2(termsToGroup, selectedGraphs, config.numThreads, whole && config.extractComputationalBasis, options, checkpoint, shards.get());
+			};
+
+			// Each collection is written out as soon as it is final, so that in chunks only the open 
+			// groups are kept in memory
+			auto outPath = std::filesystem::path(fileForPoint(outfilename, numGraphs));
+			std::filesystem::create_directories(outPath.parent_path());
+			std::ofstream file{ outPath };
+			JsonFormatting::PauliCollectionPrinter printer{ std::ostream_iterator<char>(file), terms };
+			ShotReductionEstimate R_hat_HT_estimate{ terms };
+			size_t numSweeps{}, numGraphsEvaluated{};
+			auto writeCollection = [&](const CollectionWithGraph& collection) {
+				printer.print(collection);
+				R_hat_HT_estimate.add(collection);
+				if (collection.numGraphsEvaluated > 0) {
+					++numSweeps;
+					numGraphsEvaluated += collection.numGraphsEvaluated;
+				}
+			};
+			if (chunked) {
+				applyChunkedGrouper(terms, chunkSize, [&](TermStore chunk, double timeLeft) { return groupTerms(std::move(chunk), timeLeft, false, true); },
+					writeCollection, config.numThreads, config.extractComputationalBasis, grouperOptions);
+			}
+			else {
+				for (const auto& collection : groupTerms(terms, grouperOptions.timeBudget, true, true)) writeCollection(collection);
+			}
+			if (cache && !shards) {
+				const auto [hits, misses, evictions] = cache->statistics();
+				println("\nFeasibility cache: {} hits, {} misses, {} evicted entries", hits, misses, evictions);
+			}
 
-		auto R_hat_HT = estimated_shot_reduction(hamiltonian, htGrouping);
-		auto R_hat_tpb = estimated_shot_reduction(hamiltonian, tpbGrouping);
+			const auto R_hat_HT = R_hat_HT_estimate.value();
 
-		const auto t1 = clock::now();
-		const auto timeInSeconds = std::chrono::duration_cast<std::chrono::seconds>(t1 - t0).count();
+			const auto t1 = clock::now();
+			const auto timeInSeconds = std::chrono::duration_cast<std::chrono::seconds>(t1 - pointStart).count();
+			printer.finish(JsonFormatting::MetaInfo{ timeInSeconds, selectedGraphs.size(), seed, connectivity });
 
-		println("Found grouping into {} subsets, run time: {}s", htGrouping.size(), timeInSeconds);
+			println("Found grouping into {} subsets, run time: {}s", printer.size(), timeInSeconds);
+			if (chunked && config.reportChunkingLoss) {
+				println("Grouping all terms at once for comparison");
+				const auto R_hat_whole = estimated_shot_reduction(terms, groupTerms(terms, grouperOptions.timeBudget, true, false));
+				println("R_hat_HT = {} in chunks, {} with all terms at once (chunking changes it by {:+.2f}%)", R_hat_HT, R_hat_whole, 100 * (R_hat_HT / R_hat_whole - 1));
+			}
+			if (config.graphBatchSize > 0 || config.timeBudget > 0) {
+				println("Graphs evaluated per group: {:.1f} on average", numSweeps == 0 ? 0. : static_cast<double>(numGraphsEvaluated) / numSweeps);
+			}
 
-		
-		auto outPath = std::filesystem::path(outfilename);
-		std::filesystem::create_directories(outPath.parent_path());
-		std::ofstream file{ outPath };
-		auto fileout = std::ostream_iterator<char>(file);
+			println("Estimated shot reduction\n R_hat_HT = {}\n R_hat_TPB = {}\n R_hat_SI = {} (run time: {}s)\n R_hat_HT/R_hat_TPB = {}", R_hat_HT, R_hat_tpb, R_hat_si, siTimeInSeconds, R_hat_HT / R_hat_tpb);
+			sweepPoints.push_back({ selectedGraphs.size(), printer.size(), R_hat_HT, timeInSeconds });
+		}
+		if (layerTables && !layerTableFile.empty() && layerTables->size() != numLoadedLayerTables) {
+			layerTables->save(layerTableFile);
+		}
 
-		JsonFormatting::printPauliCollections(fileout, htGrouping, JsonFormatting::MetaInfo{ timeInSeconds, selectedGraphs.size(), seed, connectivity });
-		println("Estimated shot reduction\n R_hat_HT = {}\n R_hat_TPB = {}\n R_hat_HT/R_hat_TPB = {}", R_hat_HT, R_hat_tpb, R_hat_HT / R_hat_tpb);
+		if (sweepPoints.size() > 1) {
+			println("\n{:>10} {:>8} {:>12} {:>10}", "numGraphs", "groups", "R_hat_HT", "run time");
+			for (const auto& [numGraphs, numGroups, R_hat_HT, timeInSeconds] : sweepPoints) {
+				println("{:>10} {:>8} {:>12.4f} {:>9}s", numGraphs, numGroups, R_hat_HT, timeInSeconds);
+			}
+		}
 	}
 	catch (ConfigReadError& e) {
 		println("ConfigReadError: {}", e.what());
@@ -1,9 +1,22 @@
-
+﻿
 #include "pauli_grouper.h"
+#include "graph_shards.h"
 #include "find_ht_circuit.h"
+#include "pauli_span.h"
+#include "binary_clifford_layer.h"
+#include "thread_pool.h"
+#include "anticommutation_matrix.h"
 #include <ranges>
-#include <thread>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <future>
 #include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
 
 
 using namespace Q;
@@ -12,26 +25,232 @@ using namespace Q;
 
 struct GraphRepr {
 	explicit GraphRepr(const Graph<>& graph) : graph(graph), connectedComponents(graph.connectedComponents(true)) {
-		for (const auto& component : connectedComponents) {
+		for (int i = 0; i < graph.numVertices(); ++i) {
+			uint64_t row{};
+			for (int k = 0; k < graph.numVertices(); ++k) {
+				if (graph.hasEdge(i, k)) row |= (1ULL << k);
+			}
+			adjacencyRows.push_back(row);
+		}
+		componentOfVertex.resize(graph.numVertices());
+		for (int i = 0; i < static_cast<int>(connectedComponents.size()); ++i) {
 			uint64_t supportVector{};
-			for (auto vertex : component) {
+			for (auto vertex : connectedComponents[i]) {
 				supportVector |= (1ULL << vertex);
+				componentOfVertex[vertex] = i;
 			}
 			connectedComponentSupportVectors.push_back(supportVector);
 		}
 	}
 
+	/// @brief Check if two Paulis commute locally on every connected component, given the 
+	///        bitstring of the qubits on which they anticommute. 
+	bool commutesOnAllComponents(uint64_t anticommutingQubits) const {
+		uint64_t parity{};
+		for (auto q = anticommutingQubits; q; q &= q - 1) {
+			parity ^= 1ULL << componentOfVertex[std::countr_zero(q)];
+		}
+		return parity == 0;
+	}
+
 	Graph<> graph;
+	// Adjacency matrix with one bitstring per row
+	std::vector<uint64_t> adjacencyRows;
 	std::vector<std::vector<int>> connectedComponents;
 	// Support vector for each connected component (a bitstring with 1 
 	// for each vertex in the connected component and zeros elsewhere). 
 	std::vector<uint64_t> connectedComponentSupportVectors;
+	// Index of the connected component of each vertex
+	std::vector<int> componentOfVertex;
+};
+
+/// @brief Index over the connected components of all graphs that tells on which graphs a single 
+///        Pauli can be measured, given its support. 
+///
+/// After the single-qubit layer, a Pauli measured on a connected component C is an element of the 
+/// stabilizer of the graph state on C, i.e. a product of X_v Z_N(v) over a subset T of C. Its support 
+/// is T together with the vertices that have an odd number of neighbors in T, so only the support 
+/// of a Pauli on C decides whether it can be measured there. The feasible supports are enumerated 
+/// once for each distinct component with 2 to maxVertices vertices. Single vertices accept every 
+/// Pauli and larger components are left to the solver. 
+class GraphIndex {
+public:
+	static constexpr size_t maxVertices = 12;
+
+	explicit GraphIndex(const std::vector<GraphRepr>& graphs) : componentsOfGraph(graphs.size()) {
+		std::map<std::vector<uint64_t>, size_t> ids;
+		for (size_t i = 0; i < graphs.size(); ++i) {
+			const auto& graph = graphs[i];
+			for (size_t c = 0; c < graph.connectedComponents.size(); ++c) {
+				const auto& vertices = graph.connectedComponents[c];
+				if (vertices.size() < 2 || vertices.size() > maxVertices) continue;
+				std::vector<uint64_t> key{ graph.connectedComponentSupportVectors[c] };
+				for (auto vertex : vertices) key.push_back(graph.adjacencyRows[vertex]);
+				const auto [it, inserted] = ids.try_emplace(std::move(key), components.size());
+				if (inserted) components.push_back(makeComponent(graph, c));
+				components[it->second].graphs.push_back(i);
+				componentsOfGraph[i].push_back(it->second);
+			}
+		}
+	}
+
+	/// @brief Set the bit of each graph on which a Pauli with the given support cannot be measured
+	void markIncompatibleGraphs(uint64_t support, std::vector<uint64_t>& incompatible) const {
+		for (const auto& component : components) {
+			if (component.feasible(support)) continue;
+			for (auto i : component.graphs) incompatible[i / 64] |= 1ULL << (i % 64);
+		}
+	}
+
+	/// @brief Check if a Pauli with the given support can be measured on graph i (on its own)
+	bool compatible(size_t i, uint64_t support) const {
+		return std::ranges::all_of(componentsOfGraph[i], [&](size_t c) { return components[c].feasible(support); });
+	}
+
+private:
+	struct Component {
+		std::vector<int> vertices;
+		uint64_t mask{};
+		std::vector<bool> feasibleSupports; // indexed by the support restricted to the vertices
+		std::vector<size_t> graphs;
+
+		bool feasible(uint64_t support) const {
+			support &= mask;
+			if (support == 0) return true;
+			size_t pattern{};
+			for (size_t k = 0; k < vertices.size(); ++k) pattern |= ((support >> vertices[k]) & 1) << k;
+			return feasibleSupports[pattern];
+		}
+	};
+
+	static Component makeComponent(const GraphRepr& graph, size_t componentIndex) {
+		Component component{ graph.connectedComponents[componentIndex], graph.connectedComponentSupportVectors[componentIndex] };
+		const auto& vertices = component.vertices;
+		component.feasibleSupports.resize(size_t{ 1 } << vertices.size());
+		component.feasibleSupports[0] = true;
+		// Go through the subsets T in Gray code order, so that each step adds or removes one vertex
+		uint64_t subset{}, oddNeighbors{};
+		for (size_t k = 1; k < component.feasibleSupports.size(); ++k) {
+			const auto vertex = vertices[std::countr_zero(k)];
+			subset ^= 1ULL << vertex;
+			oddNeighbors ^= graph.adjacencyRows[vertex];
+			const auto support = subset | oddNeighbors;
+			size_t pattern{};
+			for (size_t j = 0; j < vertices.size(); ++j) pattern |= ((support >> vertices[j]) & 1) << j;
+			component.feasibleSupports[pattern] = true;
+		}
+		return component;
+	}
+
+	std::vector<Component> components;
+	std::vector<std::vector<size_t>> componentsOfGraph;
+};
+
+/// @brief Success statistics of the graphs and of their edges over the sweeps, used to evaluate 
+///        promising graphs first. 
+///
+/// The reward of a graph in a sweep is the size of its collection relative to the best collection 
+/// of the sweep, so the winner gets 1 and graphs that came close get almost 1. Abandoned graphs 
+/// are rewarded for the part of the collection found before. Since the remaining terms change, 
+/// older sweeps are discounted. The graphs are ordered by an upper confidence bound of their 
+/// mean reward, where a graph that has rarely been evaluated starts from the mean reward of 
+/// its edges. 
+class GraphStatistics {
+public:
+	GraphStatistics(const std::vector<Graph<>>& graphs, int numQubits)
+		: graphRewards(graphs.size()), graphCounts(graphs.size()),
+		edgeRewards(numQubits * numQubits), edgeCounts(numQubits * numQubits) {
+		for (const auto& graph : graphs) {
+			auto& edges = edgesOfGraph.emplace_back();
+			for (auto [u, v] : graph.getEdges()) edges.push_back(u * numQubits + v);
+		}
+	}
+
+	/// @brief Add the rewards of a sweep, negative for graphs that have not been evaluated
+	void addSweep(const std::vector<double>& rewards) {
+		for (auto* values : { &graphRewards, &graphCounts, &edgeRewards, &edgeCounts }) {
+			for (auto& value : *values) value *= discount;
+		}
+		totalReward *= discount;
+		totalCount *= discount;
+		for (size_t i = 0; i < rewards.size(); ++i) {
+			if (rewards[i] < 0) continue;
+			graphRewards[i] += rewards[i];
+			graphCounts[i] += 1;
+			for (auto edge : edgesOfGraph[i]) {
+				edgeRewards[edge] += rewards[i];
+				edgeCounts[edge] += 1;
+			}
+			totalReward += rewards[i];
+			totalCount += 1;
+		}
+		++numSweeps;
+	}
+
+	/// @brief Sort the graph indices by descending priority, ties keep the given order of the graphs
+	void sort(std::vector<size_t>& order) const {
+		const auto meanReward = totalCount > 0 ? totalReward / totalCount : 0.;
+		std::vector<double> priorities(graphRewards.size());
+		for (size_t i = 0; i < priorities.size(); ++i) {
+			auto prior = meanReward;
+			if (!edgesOfGraph[i].empty()) {
+				prior = 0;
+				for (auto edge : edgesOfGraph[i]) prior += (edgeRewards[edge] + meanReward) / (edgeCounts[edge] + 1);
+				prior /= static_cast<double>(edgesOfGraph[i].size());
+			}
+			const auto count = graphCounts[i] + 1;
+			priorities[i] = (graphRewards[i] + prior) / count + exploration * std::sqrt(std::log(static_cast<double>(numSweeps) + 1) / count);
+		}
+		std::iota(order.begin(), order.end(), 0);
+		std::ranges::stable_sort(order, std::greater{}, [&](size_t i) { return priorities[i]; });
+	}
+
+	/// @brief All statistics in one array for checkpoints
+	std::vector<double> state() const {
+		std::vector<double> result;
+		for (const auto* values : { &graphRewards, &graphCounts, &edgeRewards, &edgeCounts }) result.insert(result.end(), values->begin(), values->end());
+		result.insert(result.end(), { totalReward, totalCount, static_cast<double>(numSweeps) });
+		return result;
+	}
+
+	/// @brief Restore the statistics from an array returned by state()
+	void restore(const std::vector<double>& state) {
+		if (state.size() != 2 * graphRewards.size() + 2 * edgeRewards.size() + 3) throw std::runtime_error("Invalid graph statistics in checkpoint");
+		auto it = state.begin();
+		for (auto* values : { &graphRewards, &graphCounts, &edgeRewards, &edgeCounts }) {
+			std::copy_n(it, values->size(), values->begin());
+			it += static_cast<std::ptrdiff_t>(values->size());
+		}
+		totalReward = it[0];
+		totalCount = it[1];
+		numSweeps = static_cast<size_t>(it[2]);
+	}
+
+private:
+	static constexpr double discount = 0.9;
+	static constexpr double exploration = 0.25;
+
+	std::vector<std::vector<int>> edgesOfGraph; // edge (u, v) with u < v has index u * numQubits + v
+	std::vector<double> graphRewards;
+	std::vector<double> graphCounts;
+	std::vector<double> edgeRewards;
+	std::vector<double> edgeCounts;
+	double totalReward{};
+	double totalCount{};
+	size_t numSweeps{};
 };
 
 void Q::computeSingleQubitLayer(CollectionWithGraph& collection, HTCircuitFinder& finder) {
 	auto repr = GraphRepr(collection.graph);
 	std::vector<BinaryCliffordGate> fullLayer(collection.graph.numVertices());
-	auto result = finder.findHTCircuit(collection.graph, collection.paulis);
+
+	// A layer that diagonalizes a basis of the span diagonalizes the entire collection
+	PauliSpan span;
+	std::vector<Pauli> generators;
+	for (const auto& pauli : collection.paulis) {
+		if (span.insert(pauli)) generators.push_back(pauli);
+	}
+	auto result = finder.findHTCircuit(collection.graph, generators);
 	if (!result) throw std::runtime_error(std::format("The collection {} could not be diagonalized", collection.paulis));
 	collection.singleQubitLayer = *result;
 	return;
@@ -48,9 +267,11 @@ void Q::computeSingleQubitLayer(CollectionWithGraph& collection, HTCircuitFinder
 	collection.singleQubitLayer = fullLayer;
 }
 
-void Q::computeSingleQubitLayer(std::vector<CollectionWithGraph>& grouping) {
-	HTCircuitFinder finder{ grouping[0].graph.numVertices() };
-	std::ranges::for_each(grouping, [&finder](auto& group) {computeSingleQubitLayer(group, finder); });
+void Q::computeSingleQubitLayer(std::vector<CollectionWithGraph>& grouping, HTSolver solver) {
+	HTCircuitFinder finder{ grouping[0].graph.numVertices(), solver };
+	std::ranges::for_each(grouping, [&finder](auto& group) {
+		if (group.singleQubitLayer.empty()) computeSingleQubitLayer(group, finder);
+		});
 
 }
 
@@ -85,35 +306,180 @@ namespace Q {
 		return finder.findHTCircuit(graph.graph, collection).has_value();
 	}
 
-	/// @brief Optimized version that checks connected components and tries diagonalizing them individually. 
+	constexpr std::array<BinaryCliffordGate, 6> cliffordGates{
+		BinaryCliffordGates::I, BinaryCliffordGates::H, BinaryCliffordGates::S,
+		BinaryCliffordGates::HS, BinaryCliffordGates::SH, BinaryCliffordGates::HSH
+	};
+
+	// Single-qubit Paulis are encoded as x + 2z, i.e. 0 = I, 1 = X, 2 = Z, 3 = Y
+	constexpr int X = 1, Z = 2;
+
+	int localPauli(const Pauli& pauli, int qubit) {
+		return static_cast<int>(pauli.x(qubit) + 2 * pauli.z(qubit));
+	}
+
+	int applyGate(const BinaryCliffordGate& gate, int pauli) {
+		const int x = pauli & 1, z = pauli >> 1;
+		return ((gate(0, 0).toInt() & x) ^ (gate(0, 1).toInt() & z)) + 2 * ((gate(1, 0).toInt() & x) ^ (gate(1, 1).toInt() & z));
+	}
+
+	/// @brief Find the single-qubit Clifford that maps from1 to to1 and from2 to to2 (from2 may be 0 = I). 
+	BinaryCliffordGate mappingGate(int from1, int to1, int from2, int to2) {
+		for (const auto& gate : cliffordGates) {
+			if (applyGate(gate, from1) == to1 && (from2 == 0 || applyGate(gate, from2) == to2)) return gate;
+		}
+		return BinaryCliffordGates::I;
+	}
+
+	/// @brief Diagonalize the generators on a single connected component of the graph and write 
+	///        the gates for this component into the layer. Components with one or two vertices 
+	///        are decided in closed form: 
+	///         - a single vertex requires all Paulis to be I or the same P which is mapped to X, 
+	///         - an edge (u,v) requires all Paulis to be II or to have distinct Paulis on u and 
+	///           distinct Paulis on v for distinct Paulis, these are mapped to XZ, ZX and YY. 
 	/// 
-	/// @param collection Collection of Paulis, the next argument pauli is expected to already be in this collection
-	/// @param pauli Newly added Pauli
+	/// @param generators Generators of the collection
 	/// @param graph Graph
-	/// @param finder Finder
-	/// @return 
-	bool is_ht_measurable_with(const std::vector<Pauli>& collection, const Pauli& pauli, const GraphRepr& graph, HTCircuitFinder& finder) {
-		//return finder.findHTCircuit(graph.graph, collection).has_value();
-		for (size_t i = 0; i < graph.connectedComponents.size(); ++i) {
-			auto& component = graph.connectedComponents[i];
-			auto support = graph.connectedComponentSupportVectors[i];
-			if (component.size() == 1) {
-				if (!locallyCommutesWithAll(collection, pauli, support)) return false;
+	/// @param componentIndex Index of the connected component of the graph
+	/// @param layer Layer to update
+	/// @param finder Finder (only used for components with more than two vertices)
+	/// @param cache Optional feasibility cache shared between threads (only used for components with more than five vertices)
+	/// @param layerTables Optional precomputed tables for components with three to five vertices
+	/// @return success
+	bool solveComponent(const std::vector<Pauli>& generators, const GraphRepr& graph, size_t componentIndex, BinaryCliffordLayer& layer, HTCircuitFinder& finder, HTFeasibilityCache* cache, HTLayerTables* layerTables) {
+		const auto& component = graph.connectedComponents[componentIndex];
+		if (component.size() == 1) {
+			const int qubit = component[0];
+			int p{};
+			for (const auto& generator : generators) {
+				const int local = localPauli(generator, qubit);
+				if (local == 0) continue;
+				if (p != 0 && local != p) return false;
+				p = local;
 			}
-			else if (component.size() == 2) {
-				if (!locallyCommutesWithAll(collection, pauli, support)) return false;
-
-				for (const auto& p : collection) {
-					if (std::popcount(p.getIdentityString() & support) == 1) return false; // they need to be entangled
+			if (p != 0) layer.set(qubit, mappingGate(p, X, 0, 0));
+			return true;
+		}
+		if (component.size() == 2) {
+			const int u = component[0], v = component[1];
+			// partner[p] holds the Pauli on v that goes with p on u (and vice versa)
+			std::array<int, 4> partnerOfU{}, partnerOfV{};
+			std::array<int, 2> firstU{}, firstV{};
+			int numPairs{};
+			for (const auto& generator : generators) {
+				const int pu = localPauli(generator, u);
+				const int pv = localPauli(generator, v);
+				if (pu == 0 && pv == 0) continue;
+				if (pu == 0 || pv == 0) return false; // they need to be entangled
+				if (partnerOfU[pu] == 0 && partnerOfV[pv] == 0) {
+					partnerOfU[pu] = pv;
+					partnerOfV[pv] = pu;
+					if (numPairs < 2) {
+						firstU[numPairs] = pu;
+						firstV[numPairs] = pv;
+					}
+					++numPairs;
+				}
+				else if (partnerOfU[pu] != pv || partnerOfV[pv] != pu) {
+					return false;
 				}
 			}
-			else {
-				auto result = finder.findHTCircuit(graph.graph, collection, component);
-				if (!result.has_value()) return false;
+			if (numPairs != 0) {
+				layer.set(u, mappingGate(firstU[0], X, firstU[1], Z));
+				layer.set(v, mappingGate(firstV[0], Z, firstV[1], X));
+			}
+			return true;
+		}
+
+		if (layerTables && component.size() <= HTLayerTables::maxVertices) {
+			return layerTables->findLayer(generators, component, graph.adjacencyRows, layer);
+		}
+
+		if (!cache) {
+			auto result = finder.findHTCircuit(graph.graph, generators, component);
+			if (!result) return false;
+			for (size_t j = 0; j < component.size(); ++j) {
+				layer.set(component[j], (*result)[j]);
 			}
+			return true;
+		}
+
+		const auto vertexMask = graph.connectedComponentSupportVectors[componentIndex];
+		thread_local HTFeasibilityCache::Key key;
+		thread_local std::vector<std::array<uint64_t, 2>> rows;
+		HTFeasibilityCache::makeKey(key, vertexMask, graph.adjacencyRows, generators, rows);
+		if (auto entry = cache->find(key)) {
+			if (entry->feasible) layer.assign(entry->layer, vertexMask);
+			return entry->feasible;
+		}
+
+		// Solve for the canonical basis from the key, so that the stored layer does not 
+		// depend on which thread computed it first. 
+		std::vector<Pauli> basis;
+		const auto basisOffset = 1 + component.size();
+		for (auto row = basisOffset; row < key.size(); row += 2) {
+			Pauli pauli{ graph.graph.numVertices() };
+			for (auto vertex : component) {
+				pauli.setX(vertex, static_cast<int>((key[row] >> vertex) & 1));
+				pauli.setZ(vertex, static_cast<int>((key[row + 1] >> vertex) & 1));
+			}
+			basis.push_back(pauli);
+		}
+		HTFeasibilityCache::Entry entry;
+		if (auto result = finder.findHTCircuit(graph.graph, basis, component)) {
+			entry.feasible = true;
+			for (size_t j = 0; j < component.size(); ++j) {
+				entry.layer.set(component[j], (*result)[j]);
+			}
+			layer.assign(entry.layer, vertexMask);
+		}
+		cache->insert(key, entry);
+		return entry.feasible;
+	}
+
+	/// @brief Optimized version that checks connected components and tries diagonalizing them individually. 
+	/// 
+	/// @param generators Generators of the collection
+	/// @param graph Graph
+	/// @param layer Layer that receives the gates on success
+	/// @param finder Finder
+	/// @param cache Optional feasibility cache
+	/// @param layerTables Optional precomputed tables for small components
+	/// @param vertices Only the connected components within these vertices are checked
+	/// @return success
+	bool is_ht_measurable_with(const std::vector<Pauli>& generators, const GraphRepr& graph, BinaryCliffordLayer& layer, HTCircuitFinder& finder, HTFeasibilityCache* cache, HTLayerTables* layerTables, uint64_t vertices = ~0ULL) {
+		for (size_t i = 0; i < graph.connectedComponents.size(); ++i) {
+			if ((graph.connectedComponentSupportVectors[i] & ~vertices) != 0) continue;
+			if (!solveComponent(generators, graph, i, layer, finder, cache, layerTables)) return false;
 		}
 		return true;
 	}
+
+	/// @brief Check if the witness layer that diagonalizes the collection also diagonalizes the new Pauli.
+	///        If not, only the connected components where the witness fails are solved again and the 
+	///        witness is updated on success. 
+	/// 
+	/// @param generators Generators of the collection, the next argument pauli is expected to already be in this list
+	/// @param pauli Newly added Pauli
+	/// @param graph Graph
+	/// @param witness Layer diagonalizing all generators except pauli
+	/// @param finder Finder
+	/// @param cache Optional feasibility cache
+	/// @param layerTables Optional precomputed tables for small components
+	/// @param vertices Only these vertices are checked, they need to be a union of connected components
+	/// @return success
+	bool extendWitness(const std::vector<Pauli>& generators, const Pauli& pauli, const GraphRepr& graph, BinaryCliffordLayer& witness, HTCircuitFinder& finder, HTFeasibilityCache* cache, HTLayerTables* layerTables, uint64_t vertices = ~0ULL) {
+		const auto violated = witness.violations(pauli, graph.adjacencyRows, vertices & (~0ULL >> (64 - graph.graph.numVertices())));
+		if (violated == 0) return true;
+
+		auto updated = witness;
+		for (size_t i = 0; i < graph.connectedComponents.size(); ++i) {
+			if ((graph.connectedComponentSupportVectors[i] & violated) == 0) continue;
+			if (!solveComponent(generators, graph, i, updated, finder, cache, layerTables)) return false;
+		}
+		witness = updated;
+		return true;
+	}
 }
 
 //
@@ -322,130 +688,1234 @@ namespace Q {
 
 
 
+/// @brief Evaluation of a list of graphs for the main Paulis of a sweep, keeping the best collection
+///        for each main Pauli. The grouper evaluates all graphs with one evaluator, a worker process
+///        evaluates its shard of the graphs (see graph_shards.h).
+///
+/// Collections are compared by a priority that includes the index of the graph in the full list,
+/// so the best collection does not depend on how the graphs are split up.
+class GraphEvaluator {
+public:
+	/// @param terms     Terms of the Hamiltonian, the active ones are the remaining terms in each sweep
+	/// @param graphs    Graphs to evaluate
+	/// @param graphIds  Index of each graph in the full list of graphs
+	/// @param options   The solver, the caches, numMainPaulis, warmStart and adaptiveGraphOrder are used
+	GraphEvaluator(const TermStore& terms, const std::vector<Graph<>>& graphs, std::vector<size_t> graphIds, ThreadPool& pool, const GrouperOptions& options)
+		: terms(terms), graphIds(std::move(graphIds)), pool(pool), cache(options.cache), layerTables(options.layerTables), warmStart(options.warmStart),
+		anticommutation(terms.xStrings(), terms.zStrings(), &pool), graphReprs(graphs.begin(), graphs.end()), graphIndex(graphReprs),
+		speculative(graphs.size() < static_cast<size_t>(pool.size())), workerStates(pool.size() + (speculative ? 1 : 0)), seeds(options.numMainPaulis),
+		previousCollections(options.warmStart ? graphs.size() : 0), graphOrder(graphs.size()) {
+
+		for (size_t i = 0; i < workerStates.size(); ++i) finders.emplace_back(terms.numQubits(), options.solver);
+		for (auto& state : workerStates) {
+			state.candidates.resize(anticommutation.numWords());
+			state.bests.resize(seeds.size());
+		}
+		std::iota(graphOrder.begin(), graphOrder.end(), 0);
+		if (options.adaptiveGraphOrder) {
+			graphStatistics.emplace(graphs, terms.numQubits());
+			collectionSizes.resize(graphs.size() * seeds.size());
+			rewards.resize(graphs.size());
+		}
+	}
+
+	/// @brief See BestCollection::makePriority()
+	static uint64_t priority(size_t size, size_t order) { return BestCollection::makePriority(size, order); }
+
+	/// @brief Evaluate the graphs for the given main Paulis (at most numMainPaulis). Only collections
+	///        with a higher priority than given for each main Pauli are kept.
+	/// @param pastDeadline Checked before each graph, no more graphs are evaluated once it returns true
+	/// @return Best collection for each main Pauli and the number of evaluated graphs
+	ShardResult evaluate(const std::vector<size_t>& mainIndices, const std::vector<uint64_t>& minPriorities, const AdaptiveGraphBudget& graphBudget,
+		const std::function<bool()>& pastDeadline, bool verbose) {
+
+		constexpr auto npos = TermStore::npos;
+		const auto numSeeds = mainIndices.size();
+		const auto numGraphs = graphReprs.size();
+
+		for (size_t j = 0; j < numSeeds; ++j) {
+			auto& [mainIndex, mainPauli, commutingPaulis, firstWord, lastWord, incompatibleGraphs, bestPriority] = seeds[j];
+			mainIndex = mainIndices[j];
+			mainPauli = terms.pauli(mainIndex);
+
+			commuting = terms.activeTerms();
+			anticommutation.removeAnticommuting(commuting, mainIndex);
+			commutingPaulis.clear();
+			for (auto index = findNextSetBit(commuting, mainIndex + 1); index != npos; index = findNextSetBit(commuting, index + 1)) {
+				commutingPaulis.emplace_back(index, (mainPauli.getXString() & terms.z(index)) ^ (mainPauli.getZString() & terms.x(index)));
+			}
+			firstWord = (mainIndex + 1) / 64;
+			lastWord = commutingPaulis.empty() ? firstWord : commutingPaulis.back().first / 64 + 1;
+
+			incompatibleGraphs.assign((numGraphs + 63) / 64, 0);
+			graphIndex.markIncompatibleGraphs(terms.support(mainIndex), incompatibleGraphs);
+
+			// Graphs that cannot beat the best collection are abandoned. Since the priority
+			// includes the graph order, this does not change the result.
+			bestPriority.store(minPriorities[j], std::memory_order_relaxed);
+		}
+		for (auto& state : workerStates) {
+			for (auto& best : state.bests) best.priority = 0;
+		}
+		std::ranges::fill(collectionSizes, 0);
+		std::ranges::fill(rewards, -1.);
+
+		std::atomic_int visitedGraphs{};
+		std::mutex printMutex;
+
+		auto updateBestPriority = [](std::atomic<uint64_t>& bestPriority, uint64_t value) {
+			auto current = bestPriority.load(std::memory_order_relaxed);
+			while (value > current && !bestPriority.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+		};
+
+		// Greedy scan of the candidates of graph i for the main Pauli of seed j in the given order
+		auto scanGraph = [&](size_t i, size_t j, WorkerState& state, HTCircuitFinder& finder) {
+			auto& [candidates, generators, termIndices, span, bests, scratch, window] = state;
+			const auto& [mainIndex, mainPauli, commutingPaulis, firstWord, lastWord, incompatibleGraphs, bestPriority] = seeds[j];
+			if ((incompatibleGraphs[i / 64] >> (i % 64)) & 1) return;
+			const auto& graphRepr = graphReprs[i];
+			const auto order = graphIds[i] + 1;
+
+			// Only Paulis that commute locally with the main Pauli on every connected component
+			// and that can be measured on the graph on their own can join the collection, which
+			// gives an upper bound for its size. While the collection grows, the candidates that
+			// anticommute with a new member are removed. Only the words between the first and
+			// the last commuting Pauli are ever touched.
+			std::fill(candidates.begin() + firstWord, candidates.begin() + lastWord, 0);
+			size_t numCandidates{};
+			for (const auto& [index, anticommutingQubits] : commutingPaulis) {
+				if (graphRepr.commutesOnAllComponents(anticommutingQubits) && graphIndex.compatible(i, terms.support(index))) {
+					candidates[index / 64] |= 1ULL << (index % 64);
+					++numCandidates;
+				}
+			}
+			if (priority(1 + numCandidates, order) < bestPriority.load(std::memory_order_relaxed)) return;
+
+			// Layer that diagonalizes the current collection. Candidates are first tested
+			// against it and only the components where it fails need to be solved again.
+			// The HT condition is linear in the Paulis, so only a basis of the collection
+			// needs to be checked and Paulis in its span are always accepted.
+			BinaryCliffordLayer witness;
+			auto startFromMainPauli = [&] {
+				witness = BinaryCliffordLayer::identity();
+				generators.assign(1, mainPauli);
+				termIndices.assign(1, mainIndex);
+				span.clear();
+				span.insert(mainPauli);
+			};
+			startFromMainPauli();
+
+			// Start from the previous collection of this graph if the main Pauli commutes with its
+			// remaining members and they can still be diagonalized together.
+			// The layer of the previous collection still diagonalizes the remaining members, so
+			// only the main Pauli needs to be checked against it.
+			auto startFromPrevious = [&] {
+				auto& [previous, previousWitness] = previousCollections[i];
+				std::erase_if(previous, [&](size_t index) { return index <= mainIndex || !terms.isActive(index); });
+				if (previous.empty()) return false;
+				if (std::ranges::any_of(previous, [&](size_t index) { return anticommutation.anticommute(mainIndex, index); })) return false;
+				generators.clear();
+				span.clear();
+				for (size_t index : previous) {
+					const auto pauli = terms.pauli(index);
+					if (span.insert(pauli)) generators.push_back(pauli);
+				}
+				witness = previousWitness;
+				if (span.insert(mainPauli)) {
+					generators.push_back(mainPauli);
+					if (!extendWitness(generators, mainPauli, graphRepr, witness, finder, cache, layerTables)) {
+						startFromMainPauli();
+						return false;
+					}
+				}
+				for (size_t index : previous) {
+					termIndices.push_back(index);
+					if ((candidates[index / 64] >> (index % 64)) & 1) --numCandidates;
+					candidates[index / 64] &= ~(1ULL << (index % 64));
+				}
+				for (size_t index : previous) {
+					numCandidates -= anticommutation.removeAnticommuting(candidates, index, firstWord, lastWord);
+				}
+				return true;
+			};
+			if (!(warmStart && startFromPrevious()) && !is_ht_measurable_with(generators, graphRepr, witness, finder, cache, layerTables)) return;
+
+			// Apply the verdict for the next candidate, returns false if the graph is abandoned
+			auto commit = [&](size_t index, Verdict verdict, const BinaryCliffordLayer& updatedWitness) {
+				--numCandidates;
+				if (priority(termIndices.size() + 1 + numCandidates, order) < bestPriority.load(std::memory_order_relaxed)) return false;
+				if (verdict == Verdict::Rejected) return true;
+				termIndices.push_back(index);
+				if (verdict == Verdict::InSpan) return true;
+
+				const auto pauli = terms.pauli(index);
+				generators.push_back(pauli);
+				span.insert(pauli);
+				witness = updatedWitness;
+				// The bits up to the current index are not looked at anymore
+				candidates[index / 64] &= ~0ULL << (index % 64);
+				numCandidates -= anticommutation.removeAnticommuting(candidates, index, index / 64, lastWord);
+				return true;
+			};
+
+			bool abandoned{};
+			if (!speculative) {
+				for (auto index = findNextSetBit(candidates, mainIndex + 1, lastWord); index != npos && !abandoned; index = findNextSetBit(candidates, index + 1, lastWord)) {
+					auto updatedWitness = witness;
+					abandoned = !commit(index, test(graphRepr, terms.pauli(index), generators, span, updatedWitness, finder), updatedWitness);
+				}
+			}
+			else {
+				// Test a window of candidates in parallel against the current collection and commit
+				// the verdicts in order. After an acceptance, a later acceptance from the same window
+				// may be wrong and the next window starts at this candidate.
+				const auto windowSize = 16 * static_cast<size_t>(pool.size());
+				auto position = mainIndex + 1;
+				while (!abandoned) {
+					window.clear();
+					for (auto index = findNextSetBit(candidates, position, lastWord); index != npos && window.size() < windowSize; index = findNextSetBit(candidates, index + 1, lastWord)) {
+						window.push_back({ index });
+					}
+					if (window.empty()) break;
+
+					pool.parallelFor(window.size(), 0, [&](int worker, size_t first, size_t last) {
+						auto& workerScratch = workerStates[worker].scratch;
+						for (auto k = first; k < last; ++k) {
+							workerScratch = generators;
+							window[k].witness = witness;
+							window[k].verdict = test(graphRepr, terms.pauli(window[k].index), workerScratch, span, window[k].witness, finders[worker]);
+						}
+					});
+
+					position = window.back().index + 1;
+					bool changed{};
+					for (const auto& [index, verdict, updatedWitness] : window) {
+						if (!((candidates[index / 64] >> (index % 64)) & 1)) continue; // removed by an earlier acceptance
+						if (changed && verdict == Verdict::Accepted) {
+							position = index;
+							break;
+						}
+						if (!commit(index, verdict, updatedWitness)) {
+							abandoned = true;
+							break;
+						}
+						changed |= verdict == Verdict::Accepted;
+					}
+				}
+			}
+			if (warmStart) {
+				std::ranges::sort(termIndices);
+				previousCollections[i].members.assign(termIndices.begin(), termIndices.end());
+				previousCollections[i].witness = witness;
+			}
+			if (graphStatistics) collectionSizes[i * seeds.size() + j] = termIndices.size();
+			if (abandoned) return;
+			const auto currentPriority = priority(termIndices.size(), order);
+			updateBestPriority(seeds[j].bestPriority, currentPriority);
+			if (auto& best = bests[j]; currentPriority > best.priority) {
+				best.priority = currentPriority;
+				best.graphIndex = graphIds[i];
+				best.termIndices.swap(termIndices);
+				best.witness = witness;
+			}
+		};
+
+		auto printProgress = [&] {
+			if (verbose && printMutex.try_lock()) {
+				print("\33[2K\rGraph {:>4} of {:>4}", visitedGraphs.load(), numGraphs);
+				printMutex.unlock();
+			}
+		};
+
+		// The graphs are handed out in the graph order, so the graphs that have been evaluated
+		// when the deadline is reached or the graph budget is exhausted are always the first ones.
+		// Graphs that are evaluated get a reward, which is set to 0 here and updated after the sweep.
+		auto evaluateGraph = [&](size_t i, WorkerState& state, HTCircuitFinder& finder) {
+			++visitedGraphs;
+			if (graphStatistics) rewards[i] = 0;
+			for (size_t j = 0; j < numSeeds; ++j) scanGraph(i, j, state, finder);
+			printProgress();
+		};
+		// Evaluate the graphs at positions [first, last) in the graph order
+		auto evaluateGraphs = [&](size_t first, size_t last) {
+			if (speculative) {
+				for (auto k = first; k < last && !pastDeadline(); ++k) {
+					evaluateGraph(graphOrder[k], workerStates.back(), finders.back());
+				}
+				return;
+			}
+			if (pastDeadline()) return;
+			std::atomic<size_t> nextGraph{ first };
+			pool.parallelFor(pool.size(), 1, [&](int worker, size_t, size_t) {
+				while (!pastDeadline()) {
+					const auto k = nextGraph.fetch_add(1, std::memory_order_relaxed);
+					if (k >= last) break;
+					evaluateGraph(graphOrder[k], workerStates[worker], finders[worker]);
+				}
+			});
+		};
+
+		// Size of the best collection for each main Pauli. Abandoned graphs cannot beat the best
+		// collection, so after each batch this does not depend on the thread schedule.
+		auto bestSizes = [&] {
+			uint64_t sum{};
+			for (size_t j = 0; j < numSeeds; ++j) sum += seeds[j].bestPriority.load(std::memory_order_relaxed) >> 32;
+			return sum;
+		};
+
+		if (graphBudget.batchSize == 0) {
+			evaluateGraphs(0, numGraphs);
+		}
+		else {
+			// Stop when the best collections did not grow for a number of batches or when the
+			// chance that the next batch improves them gets too small. The chance per graph
+			// is estimated with the rule of succession from the graphs evaluated since the last
+			// improvement.
+			size_t batchesWithoutImprovement{};
+			size_t graphsWithoutImprovement{};
+			auto previousBestSizes = bestSizes();
+			for (size_t first = 0; first < numGraphs && !pastDeadline(); first += graphBudget.batchSize) {
+				const auto last = std::min(numGraphs, first + graphBudget.batchSize);
+				evaluateGraphs(first, last);
+				if (const auto currentBestSizes = bestSizes(); currentBestSizes > previousBestSizes) {
+					previousBestSizes = currentBestSizes;
+					batchesWithoutImprovement = 0;
+					graphsWithoutImprovement = 0;
+					continue;
+				}
+				++batchesWithoutImprovement;
+				graphsWithoutImprovement += last - first;
+				if (graphBudget.maxBatchesWithoutImprovement > 0 && batchesWithoutImprovement >= graphBudget.maxBatchesWithoutImprovement) break;
+				const auto improvementProbability = 1 - std::pow(1 - 1. / static_cast<double>(graphsWithoutImprovement + 2), static_cast<double>(graphBudget.batchSize));
+				if (improvementProbability < graphBudget.minImprovementProbability) break;
+			}
+		}
+
+		ShardResult result{ static_cast<size_t>(visitedGraphs.load()) };
+		for (size_t j = 0; j < numSeeds; ++j) {
+			auto& best = std::ranges::max_element(workerStates, std::less{}, [j](const auto& state) { return state.bests[j].priority; })->bests[j];
+			result.bests.push_back(std::move(best));
+		}
+
+		if (graphStatistics) {
+			for (size_t i = 0; i < numGraphs; ++i) {
+				if (rewards[i] < 0) continue;
+				for (size_t j = 0; j < numSeeds; ++j) {
+					const auto bestSize = static_cast<double>(seeds[j].bestPriority.load(std::memory_order_relaxed) >> 32);
+					rewards[i] = std::max(rewards[i], static_cast<double>(collectionSizes[i * seeds.size() + j]) / bestSize);
+				}
+			}
+			graphStatistics->addSweep(rewards);
+			graphStatistics->sort(graphOrder);
+		}
+		return result;
+	}
+
+	/// @brief Add the state of the warm starts and of the graph order to a checkpoint
+	void save(GroupingCheckpoint& checkpoint) const {
+		if (graphStatistics) {
+			checkpoint.graphOrder.assign(graphOrder.begin(), graphOrder.end());
+			checkpoint.graphStatistics = graphStatistics->state();
+		}
+		for (const auto& [members, witness] : previousCollections) {
+			checkpoint.previousMembers.push_back(members);
+			checkpoint.previousWitnesses.push_back(witness);
+		}
+	}
+
+	/// @brief Restore the state of the warm starts and of the graph order from a checkpoint
+	void restore(const GroupingCheckpoint& checkpoint) {
+		if (checkpoint.previousMembers.size() != previousCollections.size() || checkpoint.previousWitnesses.size() != previousCollections.size()
+			|| checkpoint.graphOrder.size() != (graphStatistics ? graphOrder.size() : 0)) {
+			throw std::runtime_error("The checkpoint was written with different warmStart or adaptiveGraphOrder settings");
+		}
+		if (std::ranges::any_of(checkpoint.previousMembers, [&](const auto& members) { return std::ranges::any_of(members, [&](auto index) { return index >= terms.size(); }); })
+			|| std::ranges::any_of(checkpoint.graphOrder, [&](auto index) { return index >= graphOrder.size(); })) {
+			throw std::runtime_error("Invalid term or graph index in checkpoint");
+		}
+		for (size_t i = 0; i < previousCollections.size(); ++i) {
+			previousCollections[i] = { checkpoint.previousMembers[i], checkpoint.previousWitnesses[i] };
+		}
+		if (graphStatistics) {
+			graphOrder.assign(checkpoint.graphOrder.begin(), checkpoint.graphOrder.end());
+			graphStatistics->restore(checkpoint.graphStatistics);
+		}
+	}
+
+private:
+	// Test of a candidate against the current collection of a graph. Rejections stay valid
+	// when the collection grows (a Pauli that anticommutes with a member or that cannot be
+	// diagonalized together with the collection cannot join a larger collection either)
+	// and so does membership in the span. Only acceptances depend on the exact collection.
+	enum class Verdict { InSpan, Rejected, Accepted };
+	struct Speculation {
+		size_t index{};
+		Verdict verdict{};
+		BinaryCliffordLayer witness;
+	};
+
+	Verdict test(const GraphRepr& graphRepr, const Pauli& pauli, std::vector<Pauli>& generators, const PauliSpan& span, BinaryCliffordLayer& witness, HTCircuitFinder& finder) const {
+		if (span.contains(pauli)) return Verdict::InSpan;
+		if (!std::ranges::all_of(graphRepr.connectedComponentSupportVectors, [&](auto supportVector) {
+			return locallyCommutesWithAll(generators, pauli, supportVector); })) {
+			return Verdict::Rejected;
+		}
+		generators.push_back(pauli);
+		const bool accepted = extendWitness(generators, pauli, graphRepr, witness, finder, cache, layerTables);
+		generators.pop_back();
+		return accepted ? Verdict::Accepted : Verdict::Rejected;
+	}
+
+	// Working buffers of one worker. They are cleared but keep their capacity, so after the
+	// first iterations no memory is allocated anymore. Only the best collection of the worker
+	// for each main Pauli is kept.
+	struct WorkerState {
+		std::vector<uint64_t> candidates;
+		std::vector<Pauli> generators;
+		std::vector<size_t> termIndices;
+		PauliSpan span;
+		std::vector<BestCollection> bests;
+
+		std::vector<Pauli> scratch;
+		std::vector<Speculation> window;
+	};
+
+	// Everything that depends on the main Pauli of a sweep
+	struct Seed {
+		size_t mainIndex{};
+		Pauli mainPauli;
+		// Remaining Paulis that commute with the main Pauli together with the qubits on which they anticommute
+		std::vector<std::pair<size_t, uint64_t>> commutingPaulis;
+		size_t firstWord{};
+		size_t lastWord{};
+		// Graphs on which the main Pauli cannot be measured, they are skipped
+		std::vector<uint64_t> incompatibleGraphs;
+		// Priority of the best collection found so far by any thread
+		std::atomic<uint64_t> bestPriority{};
+	};
+
+	// Last collection of each graph for warm starts
+	struct PreviousCollection {
+		std::vector<uint32_t> members;
+		BinaryCliffordLayer witness;
+	};
+
+	const TermStore& terms;
+	std::vector<size_t> graphIds;
+	ThreadPool& pool;
+	HTFeasibilityCache* cache;
+	HTLayerTables* layerTables;
+	bool warmStart;
+
+	const AnticommutationMatrix anticommutation;
+	std::vector<GraphRepr> graphReprs;
+	const GraphIndex graphIndex;
+
+	// With fewer graphs than threads, the graphs are scanned one after another by the calling
+	// thread while the candidates of each graph are tested speculatively on the pool. This
+	// needs an additional state and finder for the calling thread.
+	bool speculative;
+	std::vector<HTCircuitFinder> finders;
+	std::vector<WorkerState> workerStates;
+	std::vector<Seed> seeds;
+	std::vector<PreviousCollection> previousCollections;
+	std::vector<uint64_t> commuting;
+
+	// Order in which the graphs are evaluated. With an adaptive order, the size of the collection
+	// found on each graph for each main Pauli is recorded and the order is updated after each sweep.
+	std::vector<size_t> graphOrder;
+	std::optional<GraphStatistics> graphStatistics;
+	std::vector<size_t> collectionSizes;
+	std::vector<double> rewards;
+};
+
+
 std::vector<CollectionWithGraph> Q::applyPauliGrouper2Multithread2(
-	const Hamiltonian& hamiltonian,
+	TermStore terms,
 	const std::vector<Graph<>>& graphs,
 	int numThreads,
 	bool extractComputationalBasis,
-	bool verbose
+	const GrouperOptions& options,
+	const CheckpointSettings& checkpoint,
+	GraphShards* shards
 ) {
-	const auto numGraphsPerThread = static_cast<size_t>(std::ceil(static_cast<float>(graphs.size()) / static_cast<float>(numThreads)));
-	std::vector<HTCircuitFinder> finders;
-	for (int i = 0; i < numThreads; ++i) finders.emplace_back(hamiltonian.numQubits);
+	// After the deadline, the current sweep only uses the graphs that have been evaluated and
+	// the remaining terms are grouped qubit-wise. A resumed run keeps the time spent before.
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+	const auto elapsedBefore = checkpoint.resumeFrom ? checkpoint.resumeFrom->elapsedSeconds : 0.;
+	const auto deadline = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(options.timeBudget - elapsedBefore));
+	auto pastDeadline = [&] { return options.timeBudget > 0 && clock::now() >= deadline; };
 
-	auto paulis = hamiltonian.operators;
+	if (shards && (checkpoint.resumeFrom || !checkpoint.filename.empty())) {
+		throw std::invalid_argument("Checkpoints are not supported together with worker processes");
+	}
 
 	std::vector<CollectionWithGraph> collections;
-	std::vector<GraphRepr> graphReprs;
+	const auto numTerms = terms.numActive();
+	constexpr auto npos = TermStore::npos;
 
 
 	auto printStatus = [&](bool deletePreviousLine) {
-		if (!verbose) return;
+		if (!options.verbose) return;
 		if (deletePreviousLine) println("\33[2K\r");
-		println("{} of {} remaining ({} group{}), {}% done: {} -> {}\n",
-			paulis.size(), hamiltonian.operators.size(), collections.size(), collections.size() == 1 ? "" : "s",
-			static_cast<int>(100 * (1 - static_cast<float>(paulis.size()) / static_cast<float>(hamiltonian.operators.size()))),
-			collections.back().paulis, collections.back().graph.getEdges());
+		println("{} of {} remaining ({} group{}), {}% done, {} graphs evaluated: {} -> {}\n",
+			terms.numActive(), numTerms, collections.size(), collections.size() == 1 ? "" : "s",
+			static_cast<int>(100 * (1 - static_cast<float>(terms.numActive()) / static_cast<float>(numTerms))),
+			collections.back().numGraphsEvaluated, collections.back().paulis, collections.back().graph.getEdges());
 	};
-	if (extractComputationalBasis) {
-		CollectionWithGraph computationalBasis{ {}, Graph<>{ hamiltonian.numQubits } };
-		std::erase_if(paulis, [&](const auto& pauli) {
-			if (pauli.first.getXString() == 0ULL) {
-				computationalBasis.paulis.push_back(pauli.first);
-				return true;
-			}
-			return false;
-			});
-		collections.push_back(computationalBasis);
+
+	// Grouped terms are removed from the store, the indices of the other terms stay the same.
+	// The graph index of each collection is kept for checkpoints.
+	constexpr auto noGraph = GroupingCheckpoint::noGraph;
+	std::vector<uint32_t> collectionGraphs;
+	auto addCollection = [&](const std::vector<size_t>& termIndices, uint32_t graphIndex) -> CollectionWithGraph& {
+		collectionGraphs.push_back(graphIndex);
+		auto& collection = collections.emplace_back(CollectionWithGraph{ {}, graphIndex == noGraph ? Graph<>{ terms.numQubits() } : graphs[graphIndex], {}, termIndices });
+		for (auto index : termIndices) {
+			collection.paulis.push_back(terms.pauli(index));
+			terms.remove(index);
+		}
+		return collection;
+	};
+
+	if (extractComputationalBasis && !checkpoint.resumeFrom) {
+		std::vector<size_t> computationalBasis;
+		for (auto index = terms.nextActive(0); index != npos; index = terms.nextActive(index + 1)) {
+			if (terms.x(index) == 0ULL) computationalBasis.push_back(index);
+		}
+		addCollection(computationalBasis, noGraph);
 		printStatus(false);
 	}
-	// Sort by magnitude in descending order 
-	std::ranges::sort(paulis, [](const auto& a, const auto& b) {return std::abs(a.second) > std::abs(b.second); });
 
+	// The graphs are either evaluated here or each worker process evaluates a shard of them
+	ThreadPool pool{ shards ? 1 : numThreads };
+	std::optional<GraphEvaluator> evaluator;
+	if (shards) {
+		ShardSetup setup{ terms.numQubits(), terms.xStrings(), terms.zStrings() };
+		for (size_t i = 0; i < terms.size(); ++i) setup.coefficients.push_back(terms.coefficient(i));
+		setup.options = options;
+		setup.cacheSize = options.cache ? options.cache->maxBytes() : 0;
+		setup.layerTables = options.layerTables != nullptr;
+		shards->start(setup, graphs);
+	}
+	else {
+		std::vector<size_t> graphIds(graphs.size());
+		std::iota(graphIds.begin(), graphIds.end(), 0);
+		evaluator.emplace(terms, graphs, std::move(graphIds), pool, options);
+	}
 
-	for (const auto& graph : graphs) graphReprs.emplace_back(graph);
+	// Fingerprint of the graphs to check that a checkpoint belongs to them
+	uint64_t graphFingerprint = 0xcbf29ce484222325ULL;
+	for (const auto& graph : graphs) {
+		for (int i = 0; i < graph.numVertices(); ++i) {
+			uint64_t row{};
+			for (int k = 0; k < graph.numVertices(); ++k) {
+				if (graph.hasEdge(i, k)) row |= 1ULL << k;
+			}
+			graphFingerprint = (graphFingerprint ^ row) * 0x100000001b3ULL;
+		}
+		graphFingerprint = (graphFingerprint ^ 0xFF) * 0x100000001b3ULL;
+	}
 
-	while (!paulis.empty()) {
-		const auto& mainPauli = paulis.front().first;
+	if (const auto* saved = checkpoint.resumeFrom) {
+		if (saved->numTerms != terms.size() || saved->numGraphs != graphs.size() || saved->graphFingerprint != graphFingerprint || saved->graphSeed != checkpoint.graphSeed) {
+			throw std::runtime_error("The checkpoint was written for different terms or graphs");
+		}
+		evaluator->restore(*saved);
+		for (const auto& entry : saved->collections) {
+			if (entry.graphIndex != noGraph && entry.graphIndex >= graphs.size()) throw std::runtime_error("Invalid graph index in checkpoint");
+			if (std::ranges::any_of(entry.termIndices, [&](auto index) { return index >= terms.size() || !terms.isActive(index); })) {
+				throw std::runtime_error("Invalid or repeated term index in checkpoint");
+			}
+			auto& collection = addCollection({ entry.termIndices.begin(), entry.termIndices.end() }, entry.graphIndex);
+			if (entry.hasLayer) collection.singleQubitLayer = entry.layer.toGates(terms.numQubits());
+			collection.numGraphsEvaluated = entry.numGraphsEvaluated;
+		}
+		if (terms.activeTerms() != saved->activeTerms) throw std::runtime_error("The groups in the checkpoint do not match its remaining terms");
+		if (!collections.empty()) printStatus(false);
+	}
 
-		CollectionWithGraph tpbCollection{ { mainPauli }, Graph<>{ hamiltonian.numQubits } };
+	// The state is copied between two sweeps and written in the background while the next sweeps
+	// run. If the previous checkpoint is still being written, the next one is written one sweep later.
+	auto makeCheckpoint = [&] {
+		GroupingCheckpoint snapshot;
+		snapshot.graphSeed = checkpoint.graphSeed;
+		snapshot.numGraphs = graphs.size();
+		snapshot.graphFingerprint = graphFingerprint;
+		snapshot.numTerms = terms.size();
+		snapshot.elapsedSeconds = elapsedBefore + std::chrono::duration<double>(clock::now() - start).count();
+		snapshot.activeTerms = terms.activeTerms();
+		for (size_t c = 0; c < collections.size(); ++c) {
+			const auto& collection = collections[c];
+			auto& entry = snapshot.collections.emplace_back();
+			entry.termIndices.assign(collection.termIndices.begin(), collection.termIndices.end());
+			entry.graphIndex = collectionGraphs[c];
+			entry.hasLayer = !collection.singleQubitLayer.empty();
+			if (entry.hasLayer) entry.layer = BinaryCliffordLayer::fromGates(collection.singleQubitLayer);
+			entry.numGraphsEvaluated = collection.numGraphsEvaluated;
+		}
+		evaluator->save(snapshot);
+		return snapshot;
+	};
+	std::future<void> pendingCheckpoint;
+	auto lastCheckpoint = start;
+	size_t sweepsSinceCheckpoint{};
+	auto checkpointDue = [&] {
+		if (checkpoint.filename.empty()) return false;
+		return (checkpoint.interval > 0 && sweepsSinceCheckpoint >= checkpoint.interval)
+			|| (checkpoint.intervalSeconds > 0 && clock::now() - lastCheckpoint >= std::chrono::duration<double>(checkpoint.intervalSeconds));
+	};
+
+	std::vector<size_t> mainIndices;
+	std::vector<Pauli> tpbPaulis;
+	std::vector<std::vector<size_t>> tpbTermIndices(options.numMainPaulis);
+	std::vector<uint64_t> tpbPriorities;
+	std::vector<uint64_t> committed((terms.size() + 63) / 64);
 
-		for (const auto& [pauli, _] : paulis | std::ranges::views::drop(1)) {
-			if (qubitwiseCommutesWithAll(tpbCollection.paulis, pauli)) {
-				tpbCollection.paulis.push_back(pauli);
+	while (terms.numActive() != 0) {
+		if (pastDeadline()) {
+			for (const auto& collection : applyTPBGrouper(terms, numThreads, false)) {
+				addCollection(collection.termIndices, noGraph).singleQubitLayer = collection.singleQubitLayer;
 			}
+			printStatus(false);
+			break;
 		}
 
-		std::atomic_int visitedGraphs{};
-		std::atomic_int finishedThreads{};
-
-		auto work = [&](size_t first, size_t last, std::vector<CollectionWithGraph>& partialSolution, HTCircuitFinder& finder) {
-			for (auto i = first; i < last; ++i) {
-				++visitedGraphs;
-				const auto& graphRepr = graphReprs[i];
-				const auto& graph = graphRepr.graph;
-				CollectionWithGraph collection{ { mainPauli }, graph };
-				if (!is_ht_measurable(collection.paulis, graphRepr, finder)) continue;
-
-				for (const auto& [pauli, _] : paulis | std::ranges::views::drop(1)) {
-					if (!commutesWithAll(collection.paulis, pauli)) continue;
-
-					bool ouch{};
-					if (!std::ranges::all_of(graphRepr.connectedComponentSupportVectors, [&](auto supportVector) {
-						return locallyCommutesWithAll(collection.paulis, pauli, supportVector); })) {
-						continue;
-					}
+		// The first remaining terms serve as main Paulis for the same sweep over the graphs.
+		// The collections on the graphs need to beat the TPB collection of their main Pauli.
+		mainIndices.clear();
+		tpbPriorities.clear();
+		for (auto index = terms.nextActive(0); index != npos && mainIndices.size() < static_cast<size_t>(options.numMainPaulis); index = terms.nextActive(index + 1)) {
+			mainIndices.push_back(index);
+		}
+		for (size_t j = 0; j < mainIndices.size(); ++j) {
+			const auto mainIndex = mainIndices[j];
+			tpbPaulis.assign(1, terms.pauli(mainIndex));
+			tpbTermIndices[j].assign(1, mainIndex);
+			for (auto index = terms.nextActive(mainIndex + 1); index != npos; index = terms.nextActive(index + 1)) {
+				if (qubitwiseCommutesWithAll(tpbPaulis, terms.pauli(index))) {
+					tpbPaulis.push_back(terms.pauli(index));
+					tpbTermIndices[j].push_back(index);
+				}
+			}
+			tpbPriorities.push_back(GraphEvaluator::priority(tpbPaulis.size(), 0));
+		}
 
-					//if (graphRepr.connectedComponents.back().size() <= 2) {
-					//	collection.paulis.push_back(pauli);
-					//	continue;
-					//}
+		ShardResult result;
+		if (shards) {
+			const auto secondsLeft = options.timeBudget > 0 ? std::max(std::chrono::duration<double>(deadline - clock::now()).count(), 1e-6) : 0.;
+			result = shards->evaluate({ secondsLeft, terms.activeTerms(), mainIndices, tpbPriorities });
+		}
+		else {
+			result = evaluator->evaluate(mainIndices, tpbPriorities, options.graphBudget, pastDeadline, options.verbose);
+		}
 
-					collection.paulis.push_back(pauli);
-					if (!is_ht_measurable(collection.paulis, graphRepr, finder)) {
-						collection.paulis.pop_back();
-					}
+		// The collections are committed in the order of the main Paulis, skipping those
+		// that share a term with a collection committed before. For each main Pauli, the
+		// TPB collection wins ties, otherwise the first graph in the list. Only the winning
+		// collections are materialized.
+		std::ranges::fill(committed, 0);
+		for (size_t j = 0; j < mainIndices.size(); ++j) {
+			const auto& best = result.bests[j];
+			const bool tpbWins = best.priority <= tpbPriorities[j];
+			const auto& termIndices = tpbWins ? tpbTermIndices[j] : best.termIndices;
+			if (std::ranges::any_of(termIndices, [&](auto index) { return (committed[index / 64] >> (index % 64)) & 1; })) continue;
+			for (auto index : termIndices) committed[index / 64] |= 1ULL << (index % 64);
+
+			if (tpbWins) {
+				addCollection(termIndices, noGraph).numGraphsEvaluated = result.numGraphsEvaluated;
+			}
+			else {
+				auto& collection = addCollection(termIndices, static_cast<uint32_t>(best.graphIndex));
+				collection.singleQubitLayer = best.witness.toGates(collection.graph.numVertices());
+				collection.numGraphsEvaluated = result.numGraphsEvaluated;
+			}
+			printStatus(true);
+		}
+
+		++sweepsSinceCheckpoint;
+		if (checkpointDue() && (!pendingCheckpoint.valid() || pendingCheckpoint.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready)) {
+			if (pendingCheckpoint.valid()) pendingCheckpoint.get(); // rethrows errors from writing the previous checkpoint
+			pendingCheckpoint = std::async(std::launch::async, [snapshot = makeCheckpoint(), filename = checkpoint.filename] { snapshot.save(filename); });
+			lastCheckpoint = clock::now();
+			sweepsSinceCheckpoint = 0;
+		}
+	}
+	if (pendingCheckpoint.valid()) pendingCheckpoint.get();
+	if (shards) shards->finish();
+	computeSingleQubitLayer(collections, options.solver);
+	return collections;
+}
+
+
+void Q::runShardWorker(ShardConnection& connection, int numThreads) {
+	MessageWriter hello;
+	hello.u32(ShardConnection::version);
+	hello.u32(static_cast<uint32_t>(numThreads));
+	connection.send(ShardConnection::MessageType::Hello, hello);
+
+	// The feasibility cache and the layer tables do not depend on the terms and are kept
+	// for all groupings.
+	ThreadPool pool{ numThreads };
+	std::unique_ptr<HTFeasibilityCache> cache;
+	std::unique_ptr<HTLayerTables> layerTables;
+	std::optional<ShardSetup> setup;
+	std::optional<TermStore> terms;
+	std::optional<GraphEvaluator> evaluator;
+
+	std::vector<uint8_t> payload;
+	while (true) {
+		const auto type = connection.receive(payload);
+		MessageReader reader{ payload };
+		try {
+			switch (type) {
+			case ShardConnection::MessageType::Setup: {
+				evaluator.reset();
+				setup = decodeSetup(reader);
+				// The terms arrive in the order of the store of the coordinator, which the
+				// stable sort of the store keeps.
+				Hamiltonian hamiltonian{ {}, setup->numQubits };
+				for (size_t i = 0; i < setup->xs.size(); ++i) {
+					hamiltonian.operators.emplace_back(Pauli::FromBitstrings(setup->numQubits, setup->xs[i], setup->zs[i]), setup->coefficients[i]);
+				}
+				terms.emplace(hamiltonian);
+				if (setup->cacheSize > 0 && (!cache || cache->maxBytes() != setup->cacheSize)) cache = std::make_unique<HTFeasibilityCache>(setup->cacheSize);
+				if (setup->layerTables && !layerTables) layerTables = std::make_unique<HTLayerTables>();
+				setup->options.cache = setup->cacheSize > 0 ? cache.get() : nullptr;
+				setup->options.layerTables = setup->layerTables ? layerTables.get() : nullptr;
+				evaluator.emplace(*terms, setup->graphs, setup->graphIds, pool, setup->options);
+				break;
+			}
+			case ShardConnection::MessageType::Sweep: {
+				if (!evaluator) throw std::runtime_error("Sweep before setup");
+				const auto sweep = decodeSweep(reader);
+				if (sweep.mainIndices.size() > static_cast<size_t>(setup->options.numMainPaulis) || std::ranges::any_of(sweep.mainIndices, [&](size_t index) { return index >= terms->size(); })) {
+					throw std::runtime_error("Invalid sweep message");
 				}
-				partialSolution.push_back(collection);
+				terms->setActiveTerms(sweep.activeTerms);
+				// The deadline is sent as the time left, so that the clocks of the processes do not need to agree
+				const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(sweep.secondsLeft));
+				const auto result = evaluator->evaluate(sweep.mainIndices, sweep.minPriorities, setup->options.graphBudget,
+					[&] { return sweep.secondsLeft > 0 && std::chrono::steady_clock::now() >= deadline; }, false);
+				MessageWriter writer;
+				encode(writer, result);
+				connection.send(ShardConnection::MessageType::Result, writer);
+				break;
+			}
+			case ShardConnection::MessageType::Finish:
+				evaluator.reset();
+				terms.reset();
+				setup.reset();
+				break;
+			case ShardConnection::MessageType::Shutdown:
+				return;
+			default:
+				throw std::runtime_error("Unexpected message");
+			}
+		}
+		catch (std::exception& e) {
+			MessageWriter writer;
+			writer.string(e.what());
+			connection.send(ShardConnection::MessageType::Error, writer);
+			throw;
+		}
+	}
+}
+
+/// @brief Assign each term in the given order to the first group that accepts it. Adding a term to a 
+///        group may only make the group more restrictive. 
+///
+/// The terms are processed in blocks. For each term of a block, the first group that accepts it 
+/// is looked up in parallel among the groups at the start of the block. Since these groups only 
+/// get more restrictive, the search for a term can start at this group when the terms are then 
+/// assigned in order. 
+/// 
+/// @param firstGroup The groups before this one are not searched
+/// @param accepts    Called with a group, a term index and the number of the calling thread
+/// @param reject     Called with each term that no group accepts, it may append a group
+template<class Group, class Accepts, class Add, class Reject>
+void assignFirstFit(const std::vector<size_t>& indices, std::vector<Group>& groups, size_t firstGroup, int numThreads, Accepts accepts, Add add, Reject reject) {
+	ThreadPool pool{ numThreads };
+	constexpr size_t blockSize = 1024;
+	std::vector<size_t> firstAccepting(blockSize);
+	for (size_t blockStart = 0; blockStart < indices.size(); blockStart += blockSize) {
+		const auto blockEnd = std::min(indices.size(), blockStart + blockSize);
+		const auto numGroups = groups.size();
+		auto findFirstAccepting = [&](int worker, size_t first, size_t last) {
+			for (auto k = first; k < last; ++k) {
+				auto group = firstGroup;
+				while (group < numGroups && !accepts(groups[group], indices[blockStart + k], worker)) ++group;
+				firstAccepting[k] = group;
 			}
-			++finishedThreads;
 		};
+		if (numThreads > 1) pool.parallelFor(blockEnd - blockStart, 0, findFirstAccepting);
+		else findFirstAccepting(0, 0, blockEnd - blockStart);
+
+		for (auto k = blockStart; k < blockEnd; ++k) {
+			auto group = firstAccepting[k - blockStart];
+			while (group < groups.size() && !accepts(groups[group], indices[k], 0)) ++group;
+			if (group == groups.size()) reject(indices[k]);
+			else add(groups[group], indices[k]);
+		}
+	}
+}
+
+/// @brief As above, a term that no group accepts opens a new group. 
+template<class Group, class Accepts, class Add>
+void assignFirstFit(const std::vector<size_t>& indices, std::vector<Group>& groups, size_t firstGroup, int numThreads, Accepts accepts, Add add) {
+	assignFirstFit(indices, groups, firstGroup, numThreads, accepts, add, [&](size_t index) { add(groups.emplace_back(), index); });
+}
+
+std::vector<CollectionWithGraph> Q::applyTPBGrouper(const TermStore& terms, int numThreads, bool extractComputationalBasis) {
+	// Measurement basis of a group: the qubits it acts on and the X and Z bits of its Pauli on them
+	struct Group {
+		uint64_t support{};
+		uint64_t x{};
+		uint64_t z{};
+		std::vector<size_t> termIndices;
+	};
+	auto accepts = [&](const Group& group, size_t index, int) {
+		return (((group.x ^ terms.x(index)) | (group.z ^ terms.z(index))) & group.support & terms.support(index)) == 0;
+	};
+	auto add = [&](Group& group, size_t index) {
+		group.support |= terms.support(index);
+		group.x |= terms.x(index);
+		group.z |= terms.z(index);
+		group.termIndices.push_back(index);
+	};
+
+	std::vector<Group> groups;
+	std::vector<size_t> remaining;
+	if (extractComputationalBasis) groups.emplace_back();
+	for (auto index = terms.nextActive(0); index != TermStore::npos; index = terms.nextActive(index + 1)) {
+		if (extractComputationalBasis && terms.x(index) == 0) add(groups[0], index);
+		else remaining.push_back(index);
+	}
+	// The computational basis group does not accept any other terms
+	assignFirstFit(remaining, groups, groups.size(), numThreads, accepts, add);
+
+	std::vector<CollectionWithGraph> collections;
+	for (const auto& [support, x, z, termIndices] : groups) {
+		auto& collection = collections.emplace_back(CollectionWithGraph{ {}, Graph<>{ terms.numQubits() }, {}, termIndices });
+		for (auto index : termIndices) collection.paulis.push_back(terms.pauli(index));
+		collection.singleQubitLayer.assign(terms.numQubits(), BinaryCliffordGates::I);
+		for (auto qubits = support; qubits; qubits &= qubits - 1) {
+			const auto qubit = std::countr_zero(qubits);
+			collection.singleQubitLayer[qubit] = mappingGate(static_cast<int>(((x >> qubit) & 1) + 2 * ((z >> qubit) & 1)), X, 0, 0);
+		}
+	}
+	return collections;
+}
+
+std::vector<CollectionWithGraph> Q::applySortedInsertion(const TermStore& terms, int numThreads) {
+	// The X and Z strings of the members are stored next to each other for the commutation test
+	struct Group {
+		std::vector<uint64_t> xs;
+		std::vector<uint64_t> zs;
+		std::vector<size_t> termIndices;
+	};
+	auto accepts = [&](const Group& group, size_t index, int) {
+		const auto x = terms.x(index), z = terms.z(index);
+		for (size_t k = 0; k < group.xs.size(); ++k) {
+			if (std::popcount((x & group.zs[k]) ^ (z & group.xs[k])) & 1) return false;
+		}
+		return true;
+	};
+	auto add = [&](Group& group, size_t index) {
+		group.xs.push_back(terms.x(index));
+		group.zs.push_back(terms.z(index));
+		group.termIndices.push_back(index);
+	};
 
-		std::vector<std::vector<CollectionWithGraph>> partialSolutions(numThreads);
+	std::vector<size_t> indices;
+	for (auto index = terms.nextActive(0); index != TermStore::npos; index = terms.nextActive(index + 1)) indices.push_back(index);
+	std::vector<Group> groups;
+	assignFirstFit(indices, groups, 0, numThreads, accepts, add);
 
-		{
-			std::vector<std::jthread> workers;
-			for (int i = 0; i < numThreads; ++i) {
-				const auto firstGraphIndex = numGraphsPerThread * i;
-				const auto lastGraphIndex = numGraphsPerThread * (i + 1);
-				workers.emplace_back(work, firstGraphIndex, std::min(lastGraphIndex, graphs.size()), std::ref(partialSolutions[i]), std::ref(finders[i]));
+	std::vector<CollectionWithGraph> collections;
+	for (const auto& group : groups) {
+		auto& collection = collections.emplace_back(CollectionWithGraph{ {}, Graph<>{ terms.numQubits() }, {}, group.termIndices });
+		for (auto index : group.termIndices) collection.paulis.push_back(terms.pauli(index));
+	}
+	return collections;
+}
+
+std::vector<CollectionWithGraph> Q::applyBlockGrouper(
+	TermStore terms,
+	const Graph<>& connectivity,
+	int blockSize,
+	int maxEdgeCount,
+	int numThreads,
+	bool extractComputationalBasis,
+	const GrouperOptions& options
+) {
+	using clock = std::chrono::steady_clock;
+	const auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(options.timeBudget));
+	auto pastDeadline = [&] { return options.timeBudget > 0 && clock::now() >= deadline; };
+	constexpr auto npos = TermStore::npos;
+	constexpr int maxBlockEdges = 16;
+	const int n = terms.numQubits();
+	if (blockSize < 1) throw std::invalid_argument("The block size needs to be at least 1");
+
+	// Blocks of contiguous qubits with all subgraphs of the connectivity on them, sorted by edge count. 
+	// The second tiling is shifted by half a block. 
+	struct Block {
+		uint64_t vertices{};
+		std::vector<GraphRepr> subgraphs;
+	};
+	std::vector<std::vector<Block>> tilings;
+	for (const int offset : { 0, blockSize / 2 }) {
+		if (!tilings.empty() && (offset == 0 || blockSize >= n)) break;
+		auto& tiling = tilings.emplace_back();
+		for (int first = 0; first < n;) {
+			const int last = std::min(n, first < offset ? offset : first + blockSize);
+			Block block{ (~0ULL >> (64 - (last - first))) << first };
+			Graph<> blockGraph{ n };
+			for (auto [u, v] : connectivity.getEdges()) {
+				if (((block.vertices >> u) & 1) && ((block.vertices >> v) & 1)) blockGraph.addEdge(u, v);
+			}
+			if (blockGraph.edgeCount() > maxBlockEdges) {
+				throw std::invalid_argument(std::format("A block of {} qubits has {} edges, at most {} are supported", last - first, blockGraph.edgeCount(), maxBlockEdges));
 			}
+			auto subgraphs = generateSubgraphs(blockGraph, 0, maxEdgeCount);
+			std::ranges::stable_sort(subgraphs, std::less{}, &Graph<>::edgeCount);
+			for (const auto& subgraph : subgraphs) block.subgraphs.emplace_back(subgraph);
+			tiling.push_back(std::move(block));
+			first = last;
+		}
+	}
+
+	ThreadPool pool{ numThreads };
+	std::vector<HTCircuitFinder> finders;
+	for (int i = 0; i < pool.size(); ++i) finders.emplace_back(n, options.solver);
+
+	std::vector<CollectionWithGraph> collections;
+	const auto numTerms = terms.numActive();
+	auto printStatus = [&](bool deletePreviousLine) {
+		if (!options.verbose) return;
+		if (deletePreviousLine) println("\33[2K\r");
+		println("{} of {} remaining ({} group{}), {}% done: {} -> {}\n",
+			terms.numActive(), numTerms, collections.size(), collections.size() == 1 ? "" : "s",
+			static_cast<int>(100 * (1 - static_cast<float>(terms.numActive()) / static_cast<float>(numTerms))),
+			collections.back().paulis, collections.back().graph.getEdges());
+	};
+	auto addCollection = [&](const std::vector<size_t>& termIndices, const Graph<>& graph) -> CollectionWithGraph& {
+		auto& collection = collections.emplace_back(CollectionWithGraph{ {}, graph, {}, termIndices });
+		for (auto index : termIndices) {
+			collection.paulis.push_back(terms.pauli(index));
+			terms.remove(index);
+		}
+		return collection;
+	};
 
-			if (verbose) {
-				int previousVisitedGraphs = -1;
-				while (finishedThreads < numThreads) {
-					if (int currentlyVisitedGraphs = visitedGraphs.load(); currentlyVisitedGraphs != previousVisitedGraphs) {
-						print("\33[2K\rGraph {:>4} of {:>4}", visitedGraphs.load(), graphs.size());
-						previousVisitedGraphs = currentlyVisitedGraphs;
+	if (extractComputationalBasis) {
+		std::vector<size_t> computationalBasis;
+		for (auto index = terms.nextActive(0); index != npos; index = terms.nextActive(index + 1)) {
+			if (terms.x(index) == 0ULL) computationalBasis.push_back(index);
+		}
+		addCollection(computationalBasis, Graph<>{ n });
+		printStatus(false);
+	}
+
+	const AnticommutationMatrix anticommutation{ terms.xStrings(), terms.zStrings(), &pool };
+
+	// A subgraph of a block on which the current collection can be measured, together with the layer
+	struct Option {
+		size_t subgraph{};
+		BinaryCliffordLayer witness;
+	};
+	struct WorkerState {
+		std::vector<std::vector<Option>> viable;   // for each block of the tiling
+		std::vector<std::vector<Option>> updated;
+		std::vector<size_t> touchedBlocks;
+		std::vector<uint64_t> candidates;
+		std::vector<uint64_t> anticommutingQubits;
+		std::vector<Pauli> generators;
+		PauliSpan span;
+	};
+	struct Result {
+		std::vector<size_t> termIndices;
+		Graph<> graph{ 0 };
+		BinaryCliffordLayer witness;
+	};
+	std::vector<WorkerState> workerStates(pool.size());
+	for (auto& state : workerStates) state.candidates.resize(anticommutation.numWords());
+
+	// Greedy search for the main Pauli with the given index on the blocks of a tiling. A candidate 
+	// is accepted if each block it acts on keeps a subgraph on which the collection can be measured. 
+	// The blocks are independent of each other, so the collection can be measured on the union of 
+	// any combination of the remaining subgraphs and each block only needs to be tested on its own. 
+	auto search = [&](size_t mainIndex, const std::vector<Block>& tiling, WorkerState& state, HTCircuitFinder& finder) {
+		auto& [viable, updated, touchedBlocks, candidates, anticommutingQubits, generators, span] = state;
+		const auto mainPauli = terms.pauli(mainIndex);
+		Result result{ { mainIndex }, Graph<>{ n } };
+		if (pastDeadline()) return result; // loses against the TPB collection
+		generators.assign(1, mainPauli);
+		span.clear();
+		span.insert(mainPauli);
+
+		viable.resize(tiling.size());
+		updated.resize(tiling.size());
+		for (size_t b = 0; b < tiling.size(); ++b) {
+			viable[b].clear();
+			for (size_t k = 0; k < tiling[b].subgraphs.size(); ++k) {
+				auto witness = BinaryCliffordLayer::identity();
+				if (is_ht_measurable_with(generators, tiling[b].subgraphs[k], witness, finder, options.cache, options.layerTables, tiling[b].vertices)) {
+					viable[b].push_back({ k, witness });
+				}
+			}
+		}
+
+		candidates = terms.activeTerms();
+		anticommutation.removeAnticommuting(candidates, mainIndex);
+		const auto lastWord = anticommutation.numWords();
+		for (auto index = findNextSetBit(candidates, mainIndex + 1); index != npos; index = findNextSetBit(candidates, index + 1)) {
+			// After the deadline, the collection found so far is kept
+			if (pastDeadline()) break;
+			const auto pauli = terms.pauli(index);
+			if (span.contains(pauli)) {
+				result.termIndices.push_back(index);
+				continue;
+			}
+
+			// Blocks on which the candidate is the identity accept it on every subgraph
+			anticommutingQubits.clear();
+			for (const auto& generator : generators) {
+				anticommutingQubits.push_back((pauli.getXString() & generator.getZString()) ^ (pauli.getZString() & generator.getXString()));
+			}
+			generators.push_back(pauli);
+			touchedBlocks.clear();
+			bool accepted = true;
+			for (size_t b = 0; b < tiling.size() && accepted; ++b) {
+				const auto& block = tiling[b];
+				if ((terms.support(index) & block.vertices) == 0) continue;
+				touchedBlocks.push_back(b);
+				updated[b].clear();
+				for (const auto& [subgraph, witness] : viable[b]) {
+					const auto& graphRepr = block.subgraphs[subgraph];
+					if (!std::ranges::all_of(anticommutingQubits, [&](uint64_t qubits) { return graphRepr.commutesOnAllComponents(qubits & block.vertices); })) continue;
+					auto updatedWitness = witness;
+					if (extendWitness(generators, pauli, graphRepr, updatedWitness, finder, options.cache, options.layerTables, block.vertices)) {
+						updated[b].push_back({ subgraph, updatedWitness });
 					}
-					using namespace std::chrono_literals;
-					std::this_thread::sleep_for(10ms);
 				}
+				accepted = !updated[b].empty();
+			}
+			if (!accepted) {
+				generators.pop_back();
+				continue;
+			}
+			for (auto b : touchedBlocks) viable[b].swap(updated[b]);
+			span.insert(pauli);
+			result.termIndices.push_back(index);
+			anticommutation.removeAnticommuting(candidates, index, index / 64, lastWord);
+		}
+
+		// Each block takes the remaining subgraph with the fewest edges
+		result.witness = BinaryCliffordLayer::identity();
+		for (size_t b = 0; b < tiling.size(); ++b) {
+			const auto& [subgraph, witness] = viable[b].front();
+			for (auto [u, v] : tiling[b].subgraphs[subgraph].graph.getEdges()) result.graph.addEdge(u, v);
+			result.witness.assign(witness, tiling[b].vertices);
+		}
+		return result;
+	};
+
+	std::vector<size_t> mainIndices;
+	std::vector<Pauli> tpbPaulis;
+	std::vector<size_t> tpbTermIndices;
+	std::vector<Result> results;
+	std::vector<uint64_t> committed((terms.size() + 63) / 64);
+
+	while (terms.numActive() != 0) {
+		if (pastDeadline()) {
+			for (const auto& collection : applyTPBGrouper(terms, numThreads, false)) {
+				addCollection(collection.termIndices, collection.graph).singleQubitLayer = collection.singleQubitLayer;
 			}
+			printStatus(false);
+			break;
 		}
 
-		const auto* bestCollection = &tpbCollection;
-		for (const auto& partialSolution : partialSolutions) {
-			for (const auto& collection : partialSolution) {
-				if (collection.size() > bestCollection->size()) bestCollection = &collection;
+		mainIndices.clear();
+		for (auto index = terms.nextActive(0); index != npos && mainIndices.size() < static_cast<size_t>(options.numMainPaulis); index = terms.nextActive(index + 1)) {
+			mainIndices.push_back(index);
+		}
+		results.assign(mainIndices.size() * tilings.size(), Result{});
+		pool.parallelFor(results.size(), 1, [&](int worker, size_t first, size_t last) {
+			for (auto task = first; task < last; ++task) {
+				results[task] = search(mainIndices[task / tilings.size()], tilings[task % tilings.size()], workerStates[worker], finders[worker]);
+			}
+		});
+
+		// As in applyPauliGrouper2Multithread2, the collections are committed in the order of the 
+		// main Paulis, skipping those that overlap with one committed before. The TPB collection 
+		// wins ties, otherwise the first tiling. 
+		std::ranges::fill(committed, 0);
+		for (size_t j = 0; j < mainIndices.size(); ++j) {
+			const auto mainIndex = mainIndices[j];
+			tpbPaulis.assign(1, terms.pauli(mainIndex));
+			tpbTermIndices.assign(1, mainIndex);
+			for (auto index = terms.nextActive(mainIndex + 1); index != npos; index = terms.nextActive(index + 1)) {
+				if (qubitwiseCommutesWithAll(tpbPaulis, terms.pauli(index))) {
+					tpbPaulis.push_back(terms.pauli(index));
+					tpbTermIndices.push_back(index);
+				}
+			}
+			const Result* best{};
+			for (size_t t = 0; t < tilings.size(); ++t) {
+				const auto& result = results[j * tilings.size() + t];
+				if (result.termIndices.size() > (best ? best->termIndices.size() : tpbTermIndices.size())) best = &result;
 			}
+			const auto& termIndices = best ? best->termIndices : tpbTermIndices;
+			if (std::ranges::any_of(termIndices, [&](auto index) { return (committed[index / 64] >> (index % 64)) & 1; })) continue;
+			for (auto index : termIndices) committed[index / 64] |= 1ULL << (index % 64);
+
+			if (best) addCollection(termIndices, best->graph).singleQubitLayer = best->witness.toGates(n);
+			else addCollection(termIndices, Graph<>{ n });
+			printStatus(true);
 		}
-		collections.push_back(*bestCollection);
-		for (const auto& pauli : bestCollection->paulis) {
-			std::erase_if(paulis, [&pauli](auto& val) { return val.first == pauli; });
+	}
+	computeSingleQubitLayer(collections, options.solver);
+	return collections;
+}
+
+size_t Q::maxChunkSize(size_t maxBytes) {
+	// A chunk of C terms needs C²/8 bytes for the anticommutation matrix and about 
+	// bytesPerTerm bytes per term for the term store, the buffers of the workers and the 
+	// open groups. This is the largest C with C²/8 + bytesPerTerm * C <= maxBytes. 
+	constexpr double bytesPerTerm = 256;
+	const auto size = 4 * (std::sqrt(bytesPerTerm * bytesPerTerm + static_cast<double>(maxBytes) / 2) - bytesPerTerm);
+	return std::max<size_t>(1, static_cast<size_t>(size));
+}
+
+void Q::applyChunkedGrouper(
+	const TermStore& terms,
+	size_t chunkSize,
+	const ChunkGrouper& groupChunk,
+	const CollectionSink& closeCollection,
+	int numThreads,
+	bool extractComputationalBasis,
+	const GrouperOptions& options
+) {
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+	const int n = terms.numQubits();
+	if (chunkSize == 0) throw std::invalid_argument("The chunk size needs to be positive");
+
+	// A group that may still take terms of the next chunks. The witness is the layer that 
+	// diagonalizes the collection on the graph, as in the grouper. 
+	struct OpenGroup {
+		CollectionWithGraph collection;
+		GraphRepr graph;
+		std::vector<Pauli> generators;
+		PauliSpan span;
+		BinaryCliffordLayer witness;
+		bool grown{};
+	};
+
+	std::vector<OpenGroup> openGroups;
+	std::vector<size_t> remaining;
+	CollectionWithGraph computationalBasis{ {}, Graph<>{ n } };
+	for (auto index = terms.nextActive(0); index != TermStore::npos; index = terms.nextActive(index + 1)) {
+		if (extractComputationalBasis && terms.x(index) == 0) {
+			computationalBasis.paulis.push_back(terms.pauli(index));
+			computationalBasis.termIndices.push_back(index);
 		}
-		printStatus(true);
+		else remaining.push_back(index);
 	}
-	computeSingleQubitLayer(collections);
+
+	const int numWorkers = std::max(1, numThreads);
+	std::vector<HTCircuitFinder> finders;
+	for (int i = 0; i < numWorkers; ++i) finders.emplace_back(n, options.solver);
+	if (extractComputationalBasis) {
+		computeSingleQubitLayer(computationalBasis, finders[0]);
+		closeCollection(std::move(computationalBasis));
+	}
+	std::vector<std::vector<Pauli>> workerGenerators(numWorkers);
+
+	// Same test as in the grouper, but on the graph and witness of an open group
+	auto accepts = [&](const OpenGroup& group, size_t index, int worker) {
+		const auto pauli = terms.pauli(index);
+		if (group.span.contains(pauli)) return true;
+		if (!std::ranges::all_of(group.graph.connectedComponentSupportVectors, [&](auto supportVector) {
+			return locallyCommutesWithAll(group.generators, pauli, supportVector); })) {
+			return false;
+		}
+		auto& generators = workerGenerators[worker];
+		generators.assign(group.generators.begin(), group.generators.end());
+		generators.push_back(pauli);
+		auto witness = group.witness;
+		return extendWitness(generators, pauli, group.graph, witness, finders[worker], options.cache, options.layerTables);
+	};
+	auto add = [&](OpenGroup& group, size_t index) {
+		const auto pauli = terms.pauli(index);
+		if (group.span.insert(pauli)) {
+			group.generators.push_back(pauli);
+			extendWitness(group.generators, pauli, group.graph, group.witness, finders[0], options.cache, options.layerTables);
+		}
+		group.collection.paulis.push_back(pauli);
+		group.collection.termIndices.push_back(index);
+		group.grown = true;
+	};
+	// Groups that took no term of a whole chunk are not expected to grow anymore and are closed
+	auto flush = [&](bool all) {
+		auto closes = [&](const OpenGroup& group) { return all || !group.grown; };
+		for (auto& group : openGroups | std::views::filter(closes)) {
+			group.collection.singleQubitLayer = group.witness.toGates(n);
+			closeCollection(std::move(group.collection));
+		}
+		std::erase_if(openGroups, closes);
+		for (auto& group : openGroups) group.grown = false;
+	};
+
+	std::vector<size_t> leftover;
+	const auto numChunks = (remaining.size() + chunkSize - 1) / chunkSize;
+	for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+		const auto first = remaining.begin() + chunk * chunkSize;
+		const std::vector<size_t> indices(first, first + std::min(chunkSize, static_cast<size_t>(remaining.end() - first)));
+
+		// The terms of the chunk first try to join the open groups in the order they were opened. 
+		// Once the time budget has run out, they are all grouped qubit-wise by groupChunk. 
+		const auto secondsLeft = options.timeBudget - std::chrono::duration<double>(clock::now() - start).count();
+		leftover.clear();
+		if (options.timeBudget > 0 && secondsLeft <= 0) leftover = indices;
+		else assignFirstFit(indices, openGroups, 0, numThreads, accepts, add, [&](size_t index) { leftover.push_back(index); });
+		const auto numOpen = openGroups.size();
+		flush(false);
+		if (options.verbose) {
+			println("Chunk {} of {}: {} terms joined open groups, {} groups closed, {} terms left for new groups",
+				chunk + 1, numChunks, indices.size() - leftover.size(), numOpen - openGroups.size(), leftover.size());
+		}
+		if (leftover.empty()) continue;
+
+		// A time budget that has run out is passed on as a minimal one
+		double timeLeft{};
+		if (options.timeBudget > 0) timeLeft = std::max(1e-9, options.timeBudget - std::chrono::duration<double>(clock::now() - start).count());
+
+		for (auto& collection : groupChunk(terms.select(leftover), timeLeft)) {
+			for (auto& index : collection.termIndices) index = leftover[index];
+			GraphRepr graph{ collection.graph };
+			auto& group = openGroups.emplace_back(OpenGroup{ std::move(collection), std::move(graph) });
+			group.witness = BinaryCliffordLayer::fromGates(group.collection.singleQubitLayer);
+			for (const auto& pauli : group.collection.paulis) {
+				if (group.span.insert(pauli)) group.generators.push_back(pauli);
+			}
+		}
+	}
+	flush(true);
+}
+
+std::vector<CollectionWithGraph> Q::applyChunkedGrouper(
+	const TermStore& terms,
+	size_t chunkSize,
+	const ChunkGrouper& groupChunk,
+	int numThreads,
+	bool extractComputationalBasis,
+	const GrouperOptions& options
+) {
+	std::vector<CollectionWithGraph> collections;
+	applyChunkedGrouper(terms, chunkSize, groupChunk, [&](CollectionWithGraph collection) { collections.push_back(std::move(collection)); },
+		numThreads, extractComputationalBasis, options);
 	return collections;
 }
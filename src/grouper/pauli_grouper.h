@@ -2,7 +2,13 @@
 
 #include "graph.h"
 #include "hamiltonian.h"
+#include "term_store.h"
 #include "ht_circuits.h"
+#include "find_ht_circuit.h"
+#include "ht_feasibility_cache.h"
+#include "ht_layer_tables.h"
+#include "checkpoint.h"
+#include <functional>
 
 
 namespace Q {
@@ -14,14 +20,46 @@ namespace Q {
 		std::vector<Pauli> paulis;
 		Graph<> graph;
 		std::vector<BinaryCliffordGate> singleQubitLayer;
+		std::vector<size_t> termIndices; // indices of the Paulis in the TermStore the grouping was computed from
+		size_t numGraphsEvaluated{};     // number of graphs evaluated in the sweep that found this collection
 		auto size() const { return paulis.size(); }
 	};
 
-	class HTCircuitFinder;
+	/// @brief Settings for evaluating the graphs of each sweep in batches and stopping early once 
+	///        the best collections stop improving. 
+	struct AdaptiveGraphBudget {
+		size_t batchSize{};                        // number of graphs per batch, 0 evaluates all graphs
+		size_t maxBatchesWithoutImprovement{};     // stop after this many batches without improvement (0 for no limit)
+		double minImprovementProbability{};        // stop when the estimated chance that the next batch improves drops below this
+	};
+
+	/// @brief Settings for writing checkpoints during a grouping run and for continuing from one. 
+	///        Checkpoints are written between two sweeps when one of the intervals has passed. 
+	struct CheckpointSettings {
+		std::string filename;                      // file to write the checkpoints to, empty disables them
+		size_t interval{};                         // write a checkpoint every this many sweeps (0 for no limit)
+		double intervalSeconds{};                  // write a checkpoint after this many seconds (0 for no limit)
+		uint64_t graphSeed{};                      // seed the graphs were generated from, stored in the checkpoints
+		const GroupingCheckpoint* resumeFrom{};    // continue from this checkpoint instead of starting over
+	};
+
+	/// @brief Options shared by the HT groupers, each grouper uses those that apply to it. 
+	struct GrouperOptions {
+		HTSolver solver{ HTSolver::Auto };         // backend for the feasibility checks, see HTSolver
+		HTFeasibilityCache* cache{};               // optional cache for the feasibility of connected components, may be shared between runs
+		HTLayerTables* layerTables{};              // optional precomputed feasibility tables for connected components with up to five vertices
+		int numMainPaulis{ 1 };                    // number of main Paulis that are searched for in the same sweep
+		bool warmStart{};                          // start the search on each graph from its previous collection
+		double timeBudget{};                       // time in seconds after which the remaining terms are grouped qubit-wise (0 for no limit)
+		AdaptiveGraphBudget graphBudget;           // evaluate the graphs of each sweep in batches and stop early
+		bool adaptiveGraphOrder{};                 // evaluate the graphs that found large collections in earlier sweeps first
+		bool verbose{ true };                      // print the current status to stdout
+	};
 
+	class GraphShards;
 
 	void computeSingleQubitLayer(CollectionWithGraph& collection, HTCircuitFinder& finder);
-	void computeSingleQubitLayer(std::vector<CollectionWithGraph>& grouping);
+	void computeSingleQubitLayer(std::vector<CollectionWithGraph>& grouping, HTSolver solver = HTSolver::Auto);
 
 
 	/// @brief Check if given pauli commutes with every other Pauli in the collection. 
@@ -94,5 +132,96 @@ namespace Q {
 	/// @param verbose       If set to true, will print current status to stdout console output
 	/// @return Sets of commuting operators
 	std::vector<CollectionWithGraph> applyPauliGrouper2Multithread(const Hamiltonian& hamiltonian, const std::vector<Graph<>>& graphs, int numThreads = 1, bool verbose = true);
-	std::vector<CollectionWithGraph> applyPauliGrouper2Multithread2(const Hamiltonian& hamiltonian, const std::vector<Graph<>>& graphs, int numThreads = 1, bool extractComputationalBasis = true, bool verbose = true);
+
+	/// @param terms         Terms of the Hamiltonian, the returned collections refer to them by index
+	/// @param options       Solver, caches and search settings, see GrouperOptions. In detail: 
+	///                      - numMainPaulis: number of main Paulis (the remaining terms with the largest coefficients) 
+	///                        that are searched for in the same sweep over the graphs. Their collections are committed 
+	///                        in order, skipping those that overlap with a collection committed before. 
+	///                      - warmStart: start the search on each graph from the remaining members of its previous 
+	///                        collection if the main Pauli can join them (this changes the result, and with several 
+	///                        threads the result may depend on the order in which the graphs are processed)
+	///                      - timeBudget: no more graphs are evaluated after this time. The current sweep is finished 
+	///                        with the graphs evaluated so far and the remaining terms are grouped qubit-wise. 
+	///                      - graphBudget: see AdaptiveGraphBudget
+	///                      - adaptiveGraphOrder: without a time or graph budget, this only makes abandoning graphs 
+	///                        more effective and does not change the result. 
+	/// @param checkpoint    Write checkpoints and resume from one, see CheckpointSettings. A resumed run gives the 
+	///                      same result as an uninterrupted one if all other arguments are the same. 
+	/// @param shards        Optional worker processes (see graph_shards.h) that evaluate the graphs instead of this 
+	///                      process, each a shard of them. Without warm starts and budgets, the result is the same. 
+	///                      The graph budget is applied by each worker to its shard. Checkpoints are not supported. 
+	std::vector<CollectionWithGraph> applyPauliGrouper2Multithread2(TermStore terms, const std::vector<Graph<>>& graphs, int numThreads = 1, bool extractComputationalBasis = true, const GrouperOptions& options = {}, const CheckpointSettings& checkpoint = {}, GraphShards* shards = nullptr);
+
+	/// @brief Group the active terms qubit-wise: each term joins the first group that uses the same 
+	///        Pauli on every qubit both act on, otherwise it opens a new group. This gives the same 
+	///        grouping as applyPauliGrouper2Multithread2 with only the edgeless graph, without solving 
+	///        anything. The single-qubit layers map the Pauli of each group on each qubit to X. 
+	/// 
+	/// @param terms         Terms of the Hamiltonian, only the active ones are grouped
+	/// @param numThreads    Number of threads that look for the first matching group of the next terms
+	/// @param extractComputationalBasis Put all terms without X or Y into the first group
+	std::vector<CollectionWithGraph> applyTPBGrouper(const TermStore& terms, int numThreads = 1, bool extractComputationalBasis = true);
+
+	/// @brief Sorted Insertion with general commutativity (https://doi.org/10.22331/q-2021-01-20-385): 
+	///        each active term joins the first group in which it commutes with all members, 
+	///        otherwise it opens a new group. The groups are in general not measurable with 
+	///        single-qubit layers, so the collections have no layer. 
+	/// 
+	/// @param terms         Terms of the Hamiltonian, only the active ones are grouped
+	/// @param numThreads    Number of threads that look for the first matching group of the next terms
+	std::vector<CollectionWithGraph> applySortedInsertion(const TermStore& terms, int numThreads = 1);
+
+	/// @brief Greedy HT grouping for Hamiltonians with too many qubits for random subgraphs of the
+	///        whole connectivity. The qubits are split into blocks of contiguous qubits, each block
+	///        gets all subgraphs of the connectivity on it, and a term is added to a collection if
+	///        every block it acts on keeps a subgraph on which the collection can be measured. The
+	///        graph of a collection is the union of one such subgraph per block, so no edge crosses
+	///        a block boundary. Each sweep tries a second tiling shifted by half a block
+	///        and keeps the larger collection, or the qubit-wise one if neither is larger.
+	///
+	/// @param terms         Terms of the Hamiltonian, only the active ones are grouped
+	/// @param connectivity  Connectivity of the device, at most 16 edges may lie within a block
+	/// @param blockSize     Number of qubits per block
+	/// @param maxEdgeCount  Maximum number of edges of the subgraph on a block
+	/// @param numThreads    Number of threads, each searches for one main Pauli and tiling at a time
+	/// @param options       As for applyPauliGrouper2Multithread2, warmStart, graphBudget and adaptiveGraphOrder are not used. 
+	///                      After the timeBudget, the searches that are running keep what they have found so far. 
+	std::vector<CollectionWithGraph> applyBlockGrouper(TermStore terms, const Graph<>& connectivity, int blockSize, int maxEdgeCount = 1000, int numThreads = 1, bool extractComputationalBasis = true, const GrouperOptions& options = {});
+
+	/// @brief Groups the terms of a chunk, given as their own TermStore, within a time budget in seconds (0 for no limit). 
+	///        The collections need single-qubit layers, e.g. applyPauliGrouper2Multithread2 or applyBlockGrouper. 
+	using ChunkGrouper = std::function<std::vector<CollectionWithGraph>(TermStore chunk, double timeBudget)>;
+
+	/// @brief Receives each collection of applyChunkedGrouper once it is closed, so that it does not 
+	///        need to be kept until the end, e.g. to write it to the output. 
+	using CollectionSink = std::function<void(CollectionWithGraph collection)>;
+
+	/// @brief Largest number of terms per chunk for which applyChunkedGrouper stays within the given 
+	///        memory, counting the anticommutation matrix of a chunk and the buffers that grow with 
+	///        the number of terms in it. The terms themselves and the open groups are not included. 
+	size_t maxChunkSize(size_t maxBytes);
+
+	/// @brief Group the terms in chunks of at most chunkSize terms, in the order of their coefficients, 
+	///        so that the memory needed does not grow with the square of the number of terms. 
+	/// 
+	/// The terms of each chunk first join the groups of the earlier chunks that are still open, each 
+	/// the first one in which it is measurable on the graph of the group. The other terms of the chunk 
+	/// are grouped by groupChunk and the new groups are opened. Groups that take no term of a whole 
+	/// chunk are closed, as groups that gave up on the larger terms rarely take the smaller ones. With 
+	/// all terms in one chunk, the result is the one of groupChunk. 
+	/// 
+	/// @param terms         Terms of the Hamiltonian, only the active ones are grouped
+	/// @param chunkSize     Maximum number of terms per chunk, see maxChunkSize()
+	/// @param groupChunk    Grouper for the terms of a chunk that join no open group
+	/// @param closeCollection Receives the computational basis group first and then each group when it 
+	///                      is closed, only the open groups are kept
+	/// @param numThreads    Number of threads that look for the first open group of the next terms
+	/// @param extractComputationalBasis Put all terms without X or Y into the first group
+	/// @param options       The solver, the caches and verbose are used for the open groups, the time left of the 
+	///                      timeBudget is passed on to groupChunk. The other options are up to groupChunk. 
+	void applyChunkedGrouper(const TermStore& terms, size_t chunkSize, const ChunkGrouper& groupChunk, const CollectionSink& closeCollection, int numThreads = 1, bool extractComputationalBasis = true, const GrouperOptions& options = {});
+
+	/// @brief As above, but returns all collections in the order they were closed
+	std::vector<CollectionWithGraph> applyChunkedGrouper(const TermStore& terms, size_t chunkSize, const ChunkGrouper& groupChunk, int numThreads = 1, bool extractComputationalBasis = true, const GrouperOptions& options = {});
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include <format>
+#include "term_store.h"
 
 
 namespace PythonFormatting {
@@ -7,10 +8,10 @@ namespace PythonFormatting {
 
 
 
-	void printPauliCollection(auto out, const auto& collection) {
+	void printPauliCollection(auto out, const auto& collection, const Q::TermStore& terms) {
 		std::format_to(out, "{{ \"operators\": [");
-		for (const auto& pauli : collection.paulis) {
-			std::format_to(out, "\"{}\",", pauli);
+		for (auto index : collection.termIndices) {
+			std::format_to(out, "\"{}\",", terms.pauli(index));
 		}
 		std::format_to(out, "], \"edges\": [");
 		for (const auto& edge : collection.graph.getEdges()) {
@@ -20,11 +21,11 @@ namespace PythonFormatting {
 	}
 	
 
-	void printPauliCollections(auto out, const auto& collections) {
+	void printPauliCollections(auto out, const auto& collections, const Q::TermStore& terms) {
 
 		std::format_to(out, "grouping = [\n");
 		for (const auto& collection : collections) {
-			printPauliCollection(out, collection);
+			printPauliCollection(out, collection, terms);
 			//std::format_to(out, "{} -> {}", collection.paulis, collection.graph.getEdges());
 		}
 		std::format_to(out, "]\n");
@@ -1,7 +1,9 @@
 ﻿#pragma once
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include "string_utility.h"
+#include "find_ht_circuit.h"
 
 namespace Q {
 
@@ -17,9 +19,29 @@ namespace Q {
 		std::string connectivity;
 		int64_t numThreads{};
 		int64_t maxEdgeCount{};
-		int64_t numGraphs{};
+		std::vector<int64_t> numGraphs; // in ascending order, one grouping is computed for each value
 		bool sortGraphsByEdgeCount{ true };
 		bool extractComputationalBasis{ true };
+		HTSolver solver{ HTSolver::Auto };
+		int64_t cacheSize{ -1 }; // in MB, 0 disables the feasibility cache
+		bool layerTables{ true };
+		std::string layerTableFile;
+		int64_t numMainPaulis{};
+		bool warmStart{ false };
+		int64_t timeBudget{}; // in seconds, 0 for no limit
+		int64_t graphBatchSize{};
+		int64_t maxBatchesWithoutImprovement{};
+		double minImprovementProbability{};
+		bool adaptiveGraphOrder{ false };
+		std::string checkpointFile;
+		int64_t checkpointInterval{};  // in sweeps
+		int64_t checkpointSeconds{};
+		bool resume{ false };
+		int64_t numWorkers{};   // worker processes that evaluate the graphs, 0 evaluates them in this process
+		std::string workerSocket; // socket the workers connect to, empty to start them as child processes
+		int64_t blockSize{};    // qubits per block of the block grouper, 0 uses random subgraphs of the whole connectivity
+		int64_t chunkMemoryLimit{}; // in MB for the feasibility cache and the anticommutation matrix of a chunk, the terms are grouped in chunks if needed to stay below it (0 for no limit)
+		bool reportChunkingLoss{ false };
 		unsigned int seed{};
 	};
 
@@ -33,6 +55,15 @@ namespace Q {
 		}
 	}
 
+	double string_to_double(const std::string& str) {
+		try {
+			return std::stod(str);
+		}
+		catch (std::exception& e) {
+			throw ConfigReadError(std::format("Invalid number: \"{}\"", str));
+		}
+	}
+
 	Configuration readConfig(const std::string& filename) {
 
 		std::ifstream file{ filename };
@@ -78,10 +109,13 @@ namespace Q {
 			}
 
 			else if (name == "numGraphs") {
-				if (config.numGraphs != 0) throw ConfigReadError("Duplicate attribute \"numGraphs\"");
-				auto numGraphs = string_to_int(value);
-				if (numGraphs < 1) throw ConfigReadError("The \"numGraphs\" attribute needs to be positive");
-				config.numGraphs = numGraphs;
+				if (!config.numGraphs.empty()) throw ConfigReadError("Duplicate attribute \"numGraphs\"");
+				for (const auto& entry : split(value, ',')) {
+					auto numGraphs = string_to_int(trim(entry, " \t"));
+					if (numGraphs < 1) throw ConfigReadError("The \"numGraphs\" attribute needs to be positive");
+					if (!config.numGraphs.empty() && numGraphs <= config.numGraphs.back()) throw ConfigReadError("The values of the \"numGraphs\" attribute need to be in ascending order");
+					config.numGraphs.push_back(numGraphs);
+				}
 			}
 			else if (name == "seed") {
 				if (config.seed != 0) throw ConfigReadError("Duplicate attribute \"seed\"");
@@ -103,6 +137,124 @@ namespace Q {
 				else throw ConfigReadError("The \"extractComputationalBasis\" attribute can only be true or false");
 				config.extractComputationalBasis = extractComputationalBasis;
 			}
+			else if (name == "solver") {
+				if (value == "auto") config.solver = HTSolver::Auto;
+				else if (value == "native") config.solver = HTSolver::Native;
+				else if (value == "gurobi") config.solver = HTSolver::Gurobi;
+				else throw ConfigReadError("The \"solver\" attribute can only be auto, native or gurobi");
+			}
+			else if (name == "cacheSize") {
+				if (config.cacheSize != -1) throw ConfigReadError("Duplicate attribute \"cacheSize\"");
+				auto cacheSize = string_to_int(value);
+				if (cacheSize < 0) throw ConfigReadError("The \"cacheSize\" attribute cannot be negative");
+				config.cacheSize = cacheSize;
+			}
+			else if (name == "layerTables") {
+				bool layerTables;
+				if (value == "true") layerTables = true;
+				else if (value == "false") layerTables = false;
+				else throw ConfigReadError("The \"layerTables\" attribute can only be true or false");
+				config.layerTables = layerTables;
+			}
+			else if (name == "numMainPaulis") {
+				if (config.numMainPaulis != 0) throw ConfigReadError("Duplicate attribute \"numMainPaulis\"");
+				auto numMainPaulis = string_to_int(value);
+				if (numMainPaulis < 1) throw ConfigReadError("The \"numMainPaulis\" attribute needs to be positive");
+				config.numMainPaulis = numMainPaulis;
+			}
+			else if (name == "warmStart") {
+				bool warmStart;
+				if (value == "true") warmStart = true;
+				else if (value == "false") warmStart = false;
+				else throw ConfigReadError("The \"warmStart\" attribute can only be true or false");
+				config.warmStart = warmStart;
+			}
+			else if (name == "timeBudget") {
+				if (config.timeBudget != 0) throw ConfigReadError("Duplicate attribute \"timeBudget\"");
+				auto timeBudget = string_to_int(value);
+				if (timeBudget < 0) throw ConfigReadError("The \"timeBudget\" attribute cannot be negative");
+				config.timeBudget = timeBudget;
+			}
+			else if (name == "graphBatchSize") {
+				if (config.graphBatchSize != 0) throw ConfigReadError("Duplicate attribute \"graphBatchSize\"");
+				auto graphBatchSize = string_to_int(value);
+				if (graphBatchSize < 0) throw ConfigReadError("The \"graphBatchSize\" attribute cannot be negative");
+				config.graphBatchSize = graphBatchSize;
+			}
+			else if (name == "maxBatchesWithoutImprovement") {
+				if (config.maxBatchesWithoutImprovement != 0) throw ConfigReadError("Duplicate attribute \"maxBatchesWithoutImprovement\"");
+				auto maxBatchesWithoutImprovement = string_to_int(value);
+				if (maxBatchesWithoutImprovement < 0) throw ConfigReadError("The \"maxBatchesWithoutImprovement\" attribute cannot be negative");
+				config.maxBatchesWithoutImprovement = maxBatchesWithoutImprovement;
+			}
+			else if (name == "minImprovementProbability") {
+				auto minImprovementProbability = string_to_double(value);
+				if (minImprovementProbability < 0 || minImprovementProbability > 1) throw ConfigReadError("The \"minImprovementProbability\" attribute needs to be between 0 and 1");
+				config.minImprovementProbability = minImprovementProbability;
+			}
+			else if (name == "adaptiveGraphOrder") {
+				bool adaptiveGraphOrder;
+				if (value == "true") adaptiveGraphOrder = true;
+				else if (value == "false") adaptiveGraphOrder = false;
+				else throw ConfigReadError("The \"adaptiveGraphOrder\" attribute can only be true or false");
+				config.adaptiveGraphOrder = adaptiveGraphOrder;
+			}
+			else if (name == "checkpointFile") {
+				if (config.checkpointFile != "") throw ConfigReadError("Duplicate attribute \"checkpointFile\"");
+				config.checkpointFile = value;
+			}
+			else if (name == "checkpointInterval") {
+				if (config.checkpointInterval != 0) throw ConfigReadError("Duplicate attribute \"checkpointInterval\"");
+				auto checkpointInterval = string_to_int(value);
+				if (checkpointInterval < 0) throw ConfigReadError("The \"checkpointInterval\" attribute cannot be negative");
+				config.checkpointInterval = checkpointInterval;
+			}
+			else if (name == "checkpointSeconds") {
+				if (config.checkpointSeconds != 0) throw ConfigReadError("Duplicate attribute \"checkpointSeconds\"");
+				auto checkpointSeconds = string_to_int(value);
+				if (checkpointSeconds < 0) throw ConfigReadError("The \"checkpointSeconds\" attribute cannot be negative");
+				config.checkpointSeconds = checkpointSeconds;
+			}
+			else if (name == "resume") {
+				bool resume;
+				if (value == "true") resume = true;
+				else if (value == "false") resume = false;
+				else throw ConfigReadError("The \"resume\" attribute can only be true or false");
+				config.resume = resume;
+			}
+			else if (name == "numWorkers") {
+				if (config.numWorkers != 0) throw ConfigReadError("Duplicate attribute \"numWorkers\"");
+				auto numWorkers = string_to_int(value);
+				if (numWorkers < 0 || numWorkers > 255) throw ConfigReadError("The \"numWorkers\" attribute can only take values between 0 and 255");
+				config.numWorkers = numWorkers;
+			}
+			else if (name == "workerSocket") {
+				if (config.workerSocket != "") throw ConfigReadError("Duplicate attribute \"workerSocket\"");
+				config.workerSocket = value;
+			}
+			else if (name == "blockSize") {
+				if (config.blockSize != 0) throw ConfigReadError("Duplicate attribute \"blockSize\"");
+				auto blockSize = string_to_int(value);
+				if (blockSize < 0 || blockSize > 64) throw ConfigReadError("The \"blockSize\" attribute can only take values between 0 and 64");
+				config.blockSize = blockSize;
+			}
+			else if (name == "chunkMemoryLimit") {
+				if (config.chunkMemoryLimit != 0) throw ConfigReadError("Duplicate attribute \"chunkMemoryLimit\"");
+				auto chunkMemoryLimit = string_to_int(value);
+				if (chunkMemoryLimit < 0) throw ConfigReadError("The \"chunkMemoryLimit\" attribute cannot be negative");
+				config.chunkMemoryLimit = chunkMemoryLimit;
+			}
+			else if (name == "reportChunkingLoss") {
+				bool reportChunkingLoss;
+				if (value == "true") reportChunkingLoss = true;
+				else if (value == "false") reportChunkingLoss = false;
+				else throw ConfigReadError("The \"reportChunkingLoss\" attribute can only be true or false");
+				config.reportChunkingLoss = reportChunkingLoss;
+			}
+			else if (name == "layerTableFile") {
+				if (config.layerTableFile != "") throw ConfigReadError("Duplicate attribute \"layerTableFile\"");
+				config.layerTableFile = value;
+			}
 			else {
 				throw ConfigReadError(std::format("Unknown attribute \"{}\"", name));
 			}
@@ -114,9 +266,24 @@ namespace Q {
 			throw ConfigReadError("No [outfilename] specified");
 		if (config.connectivity == "")
 			throw ConfigReadError("No [connectivity] specified");
-		if (config.numGraphs == 0) config.numGraphs = 100;
+		if (config.numGraphs.empty()) config.numGraphs = { 100 };
 		if (config.maxEdgeCount == 0) config.maxEdgeCount = 1000;
 		if (config.numThreads == 0) config.numThreads = 1;
+		// Within a chunk memory limit, the feasibility cache gets a quarter of it by default
+		if (config.cacheSize == -1) config.cacheSize = config.chunkMemoryLimit > 0 ? std::min<int64_t>(256, config.chunkMemoryLimit / 4) : 256;
+		if (config.chunkMemoryLimit > 0 && config.cacheSize >= config.chunkMemoryLimit)
+			throw ConfigReadError("The \"cacheSize\" attribute needs to be less than \"chunkMemoryLimit\", which includes the cache");
+		if (config.numMainPaulis == 0) config.numMainPaulis = 1;
+		if (config.resume && config.checkpointFile == "")
+			throw ConfigReadError("The \"resume\" attribute needs a [checkpointFile]");
+		if (config.numWorkers > 0 && config.checkpointFile != "")
+			throw ConfigReadError("The \"checkpointFile\" attribute cannot be combined with \"numWorkers\"");
+		if (config.chunkMemoryLimit > 0 && config.checkpointFile != "")
+			throw ConfigReadError("The \"checkpointFile\" attribute cannot be combined with \"chunkMemoryLimit\"");
+		if (config.blockSize > 0 && (config.numWorkers > 0 || config.checkpointFile != "" || config.numGraphs.size() > 1))
+			throw ConfigReadError("The \"blockSize\" attribute cannot be combined with \"numWorkers\", \"checkpointFile\" or several values for \"numGraphs\"");
+		if (config.blockSize > 0 && (config.warmStart || config.graphBatchSize > 0 || config.adaptiveGraphOrder))
+			throw ConfigReadError("The \"blockSize\" attribute cannot be combined with \"warmStart\", \"graphBatchSize\" or \"adaptiveGraphOrder\"");
 
 		return config;
 	}
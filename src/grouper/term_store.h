@@ -0,0 +1,111 @@
+#pragma once
+
+#include "hamiltonian.h"
+#include "anticommutation_matrix.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace Q {
+
+	/// @brief Terms of a Hamiltonian stored as separate contiguous arrays and sorted by the
+	///        magnitude of their coefficients in descending order.
+	///
+	/// Terms are addressed by their index in this order. Removing a term only clears its bit in
+	/// the active-term bitmap, the arrays themselves never change.
+	class TermStore {
+	public:
+		TermStore() = default;
+
+		explicit TermStore(const Hamiltonian& hamiltonian) : n(hamiltonian.numQubits) {
+			auto operators = hamiltonian.operators;
+			std::ranges::stable_sort(operators, [](const auto& a, const auto& b) { return std::abs(a.second) > std::abs(b.second); });
+			for (const auto& [pauli, coefficient] : operators) {
+				xs.push_back(pauli.getXString());
+				zs.push_back(pauli.getZString());
+				coefficients.push_back(coefficient);
+				supports.push_back(pauli.getXString() | pauli.getZString());
+				weights.push_back(pauli.pauliWeight());
+			}
+			active.resize((size() + 63) / 64);
+			for (size_t i = 0; i < size(); ++i) active[i / 64] |= 1ULL << (i % 64);
+			numActiveTerms = size();
+		}
+
+		size_t size() const { return xs.size(); }
+		int numQubits() const { return n; }
+
+		uint64_t x(size_t i) const { return xs[i]; }
+		uint64_t z(size_t i) const { return zs[i]; }
+		double coefficient(size_t i) const { return coefficients[i]; }
+		/// @brief Qubits on which term i is not the identity
+		uint64_t support(size_t i) const { return supports[i]; }
+		int weight(size_t i) const { return weights[i]; }
+
+		/// @brief Pauli of term i (the sign is carried by the coefficient)
+		Pauli pauli(size_t i) const { return Pauli::FromBitstrings(n, xs[i], zs[i]); }
+
+		const std::vector<uint64_t>& xStrings() const { return xs; }
+		const std::vector<uint64_t>& zStrings() const { return zs; }
+
+
+		/// @brief Bitmap with a 1 for each term that has not been removed
+		const std::vector<uint64_t>& activeTerms() const { return active; }
+		size_t numActive() const { return numActiveTerms; }
+		bool isActive(size_t i) const { return (active[i / 64] >> (i % 64)) & 1; }
+
+		/// @brief First active term at or after the given index, npos if there is none
+		size_t nextActive(size_t i) const { return findNextSetBit(active, i); }
+
+		void remove(size_t i) {
+			if (!isActive(i)) return;
+			active[i / 64] &= ~(1ULL << (i % 64));
+			--numActiveTerms;
+		}
+
+		/// @brief Replace the active-term bitmap, e.g. with the one of another store of the same terms
+		void setActiveTerms(const std::vector<uint64_t>& bits) {
+			if (bits.size() != active.size()) throw std::invalid_argument("The active-term bitmap does not match the number of terms");
+			active = bits;
+			if (size() % 64 != 0) active.back() &= (1ULL << (size() % 64)) - 1;
+			numActiveTerms = 0;
+			for (auto word : active) numActiveTerms += std::popcount(word);
+		}
+
+		/// @brief Store of the given terms, all active. The indices need to be ascending so that the
+		///        terms stay sorted. Term k of the new store is term indices[k] of this one.
+		TermStore select(const std::vector<size_t>& indices) const {
+			if (!std::ranges::is_sorted(indices)) throw std::invalid_argument("The selected terms need to be in ascending order");
+			TermStore selection;
+			selection.n = n;
+			for (auto i : indices) {
+				selection.xs.push_back(xs[i]);
+				selection.zs.push_back(zs[i]);
+				selection.coefficients.push_back(coefficients[i]);
+				selection.supports.push_back(supports[i]);
+				selection.weights.push_back(weights[i]);
+			}
+			selection.active.resize((selection.size() + 63) / 64);
+			for (size_t i = 0; i < selection.size(); ++i) selection.active[i / 64] |= 1ULL << (i % 64);
+			selection.numActiveTerms = selection.size();
+			return selection;
+		}
+
+		static constexpr auto npos = std::numeric_limits<size_t>::max();
+
+	private:
+		int n{};
+		std::vector<uint64_t> xs;
+		std::vector<uint64_t> zs;
+		std::vector<double> coefficients;
+		std::vector<uint64_t> supports;
+		std::vector<int> weights;
+
+		std::vector<uint64_t> active;
+		size_t numActiveTerms{};
+	};
+
+}
@@ -0,0 +1,114 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "checkpoint.h"
+
+
+using namespace Q;
+
+namespace {
+	GroupingCheckpoint exampleCheckpoint() {
+		GroupingCheckpoint checkpoint;
+		checkpoint.graphSeed = 12345;
+		checkpoint.numGraphs = 3;
+		checkpoint.graphFingerprint = 0xCBF29CE484222325;
+		checkpoint.numTerms = 70;
+		checkpoint.elapsedSeconds = 1.5;
+		checkpoint.activeTerms = { ~0ULL & ~0b1011ULL, 0b111001 };
+		checkpoint.collections.push_back({ { 0, 1 }, GroupingCheckpoint::noGraph, true, BinaryCliffordLayer::identity(), 0 });
+		checkpoint.collections.push_back({ { 3, 65, 66 }, 2, false, {}, 3 });
+		checkpoint.graphOrder = { 2, 0, 1 };
+		checkpoint.graphStatistics = { 0.5, 1, 2 };
+		checkpoint.previousMembers = { { 4, 5 }, {}, { 69 } };
+		checkpoint.previousWitnesses = { BinaryCliffordLayer{ 1, 2, 3, 4 }, {}, {} };
+		return checkpoint;
+	}
+
+	std::string checkpointPath(const std::string& name) {
+		return (std::filesystem::temp_directory_path() / ("ht_grouper_" + name + ".bin")).string();
+	}
+
+	/// Save the checkpoint and cut the file to the given size (if smaller)
+	void saveTruncated(const GroupingCheckpoint& checkpoint, const std::string& filename, uintmax_t size) {
+		checkpoint.save(filename);
+		if (size < std::filesystem::file_size(filename)) std::filesystem::resize_file(filename, size);
+	}
+}
+
+TEST_CASE("GroupingCheckpoint save and load") {
+	const auto filename = checkpointPath("round_trip");
+	const auto checkpoint = exampleCheckpoint();
+	checkpoint.save(filename);
+	REQUIRE_FALSE(std::filesystem::exists(filename + ".tmp"));
+
+	const auto loaded = GroupingCheckpoint::load(filename);
+	REQUIRE(loaded.graphSeed == checkpoint.graphSeed);
+	REQUIRE(loaded.numGraphs == checkpoint.numGraphs);
+	REQUIRE(loaded.graphFingerprint == checkpoint.graphFingerprint);
+	REQUIRE(loaded.numTerms == checkpoint.numTerms);
+	REQUIRE(loaded.elapsedSeconds == checkpoint.elapsedSeconds);
+	REQUIRE(loaded.activeTerms == checkpoint.activeTerms);
+	REQUIRE(loaded.collections.size() == 2);
+	for (size_t i = 0; i < 2; ++i) {
+		REQUIRE(loaded.collections[i].termIndices == checkpoint.collections[i].termIndices);
+		REQUIRE(loaded.collections[i].graphIndex == checkpoint.collections[i].graphIndex);
+		REQUIRE(loaded.collections[i].hasLayer == checkpoint.collections[i].hasLayer);
+		REQUIRE(loaded.collections[i].layer.a == checkpoint.collections[i].layer.a);
+		REQUIRE(loaded.collections[i].layer.d == checkpoint.collections[i].layer.d);
+		REQUIRE(loaded.collections[i].numGraphsEvaluated == checkpoint.collections[i].numGraphsEvaluated);
+	}
+	REQUIRE(loaded.graphOrder == checkpoint.graphOrder);
+	REQUIRE(loaded.graphStatistics == checkpoint.graphStatistics);
+	REQUIRE(loaded.previousMembers == checkpoint.previousMembers);
+	REQUIRE(loaded.previousWitnesses.size() == 3);
+	REQUIRE(loaded.previousWitnesses[0].c == 3);
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("GroupingCheckpoint truncated file") {
+	const auto filename = checkpointPath("truncated");
+	const auto checkpoint = exampleCheckpoint();
+	checkpoint.save(filename);
+	const auto size = std::filesystem::file_size(filename);
+	for (uintmax_t cut = 0; cut < size; cut += 7) {
+		saveTruncated(checkpoint, filename, cut);
+		REQUIRE_THROWS(GroupingCheckpoint::load(filename));
+	}
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("GroupingCheckpoint invalid indices") {
+	const auto filename = checkpointPath("invalid");
+	auto requireInvalid = [&](const GroupingCheckpoint& checkpoint) {
+		checkpoint.save(filename);
+		REQUIRE_THROWS(GroupingCheckpoint::load(filename));
+	};
+
+	auto checkpoint = exampleCheckpoint();
+	checkpoint.collections[1].termIndices.push_back(4000000000);
+	requireInvalid(checkpoint);
+
+	checkpoint = exampleCheckpoint();
+	checkpoint.collections[1].termIndices[0] = 1; // already in the first collection
+	requireInvalid(checkpoint);
+
+	checkpoint = exampleCheckpoint();
+	checkpoint.collections[1].termIndices.push_back(4); // still active
+	requireInvalid(checkpoint);
+
+	checkpoint = exampleCheckpoint();
+	checkpoint.collections[1].graphIndex = 3;
+	requireInvalid(checkpoint);
+
+	checkpoint = exampleCheckpoint();
+	checkpoint.activeTerms[1] |= 1ULL << 6; // beyond the last term
+	requireInvalid(checkpoint);
+
+	checkpoint = exampleCheckpoint();
+	checkpoint.previousMembers[2] = { 70 };
+	requireInvalid(checkpoint);
+
+	checkpoint = exampleCheckpoint();
+	checkpoint.graphOrder[0] = 3;
+	requireInvalid(checkpoint);
+	std::filesystem::remove(filename);
+}
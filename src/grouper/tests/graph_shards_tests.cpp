@@ -0,0 +1,107 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "graph_shards.h"
+
+
+using namespace Q;
+
+TEST_CASE("MessageWriter and MessageReader") {
+	MessageWriter writer;
+	writer.u8(0xAB);
+	writer.u32(0x12345678);
+	writer.u64(~0ULL);
+	writer.f64(-0.125);
+	writer.u64s({ 1, 2, 3 });
+	writer.indices({ 7 });
+	writer.string("socket");
+	REQUIRE(writer.data()[1] == 0x78); // little-endian
+
+	MessageReader reader{ writer.data() };
+	REQUIRE(reader.u8() == 0xAB);
+	REQUIRE(reader.u32() == 0x12345678);
+	REQUIRE(reader.u64() == ~0ULL);
+	REQUIRE(reader.f64() == -0.125);
+	REQUIRE(reader.u64s() == std::vector<uint64_t>{ 1, 2, 3 });
+	REQUIRE(reader.indices() == std::vector<size_t>{ 7 });
+	REQUIRE(reader.string() == "socket");
+	REQUIRE_THROWS(reader.u8());
+
+	// an array length beyond the end of the message
+	MessageWriter lengthOnly;
+	lengthOnly.u64(1000);
+	MessageReader truncated{ lengthOnly.data() };
+	REQUIRE_THROWS(truncated.u64s());
+}
+
+TEST_CASE("ShardSetup encoding") {
+	ShardSetup setup;
+	setup.numQubits = 3;
+	setup.xs = { 0b001, 0b110 };
+	setup.zs = { 0b011, 0b000 };
+	setup.coefficients = { 1.5, -0.25 };
+	setup.graphIds = { 4, 9 };
+	Graph<> graph{ 3 };
+	graph.addEdge(0, 2);
+	setup.graphs = { Graph<>{ 3 }, graph };
+	setup.options.solver = HTSolver::Native;
+	setup.options.numMainPaulis = 3;
+	setup.options.warmStart = true;
+	setup.options.adaptiveGraphOrder = true;
+	setup.options.graphBudget = { 100, 4, 0.05 };
+	setup.cacheSize = 1 << 20;
+	setup.layerTables = true;
+
+	MessageWriter writer;
+	encode(writer, setup);
+	MessageReader reader{ writer.data() };
+	const auto decoded = decodeSetup(reader);
+	REQUIRE(decoded.numQubits == 3);
+	REQUIRE(decoded.xs == setup.xs);
+	REQUIRE(decoded.zs == setup.zs);
+	REQUIRE(decoded.coefficients == setup.coefficients);
+	REQUIRE(decoded.graphIds == setup.graphIds);
+	REQUIRE(decoded.graphs == setup.graphs);
+	REQUIRE(decoded.options.solver == HTSolver::Native);
+	REQUIRE(decoded.options.numMainPaulis == 3);
+	REQUIRE(decoded.options.warmStart);
+	REQUIRE(decoded.options.adaptiveGraphOrder);
+	REQUIRE(decoded.options.graphBudget.batchSize == 100);
+	REQUIRE(decoded.options.graphBudget.maxBatchesWithoutImprovement == 4);
+	REQUIRE(decoded.options.graphBudget.minImprovementProbability == 0.05);
+	REQUIRE(decoded.cacheSize == 1 << 20);
+	REQUIRE(decoded.layerTables);
+
+	auto bytes = writer.data();
+	bytes.pop_back();
+	MessageReader truncated{ bytes };
+	REQUIRE_THROWS(decodeSetup(truncated));
+}
+
+TEST_CASE("ShardSweep and ShardResult encoding") {
+	const ShardSweep sweep{ 2.5, { 0b1011 }, { 0, 3 }, { 0, 17 } };
+	MessageWriter sweepWriter;
+	encode(sweepWriter, sweep);
+	MessageReader sweepReader{ sweepWriter.data() };
+	const auto decodedSweep = decodeSweep(sweepReader);
+	REQUIRE(decodedSweep.secondsLeft == 2.5);
+	REQUIRE(decodedSweep.activeTerms == sweep.activeTerms);
+	REQUIRE(decodedSweep.mainIndices == sweep.mainIndices);
+	REQUIRE(decodedSweep.minPriorities == sweep.minPriorities);
+
+	ShardResult result;
+	result.numGraphsEvaluated = 12;
+	result.bests.push_back({ 5, 9, { 0, 1, 3 }, BinaryCliffordLayer{ 1, 2, 3, 4 } });
+	result.bests.emplace_back();
+	MessageWriter resultWriter;
+	encode(resultWriter, result);
+	MessageReader resultReader{ resultWriter.data() };
+	const auto decodedResult = decodeResult(resultReader);
+	REQUIRE(decodedResult.numGraphsEvaluated == 12);
+	REQUIRE(decodedResult.bests.size() == 2);
+	REQUIRE(decodedResult.bests[0].priority == 5);
+	REQUIRE(decodedResult.bests[0].graphIndex == 9);
+	REQUIRE(decodedResult.bests[0].termIndices == std::vector<size_t>{ 0, 1, 3 });
+	REQUIRE(decodedResult.bests[0].witness.a == 1);
+	REQUIRE(decodedResult.bests[0].witness.d == 4);
+	REQUIRE(decodedResult.bests[1].termIndices.empty());
+}
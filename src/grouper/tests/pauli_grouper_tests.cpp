@@ -0,0 +1,117 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "pauli_grouper.h"
+#include "read_hamiltonians.h"
+#include "data_path.h"
+
+
+using namespace Q;
+
+namespace {
+	std::vector<size_t> sorted(std::vector<size_t> indices) {
+		std::ranges::sort(indices);
+		return indices;
+	}
+
+	/// Check that each active term is in exactly one collection and that no other term is
+	void requireActiveTermsGroupedOnce(const TermStore& terms, const std::vector<CollectionWithGraph>& grouping) {
+		std::vector<int> count(terms.size());
+		for (const auto& collection : grouping) {
+			REQUIRE(collection.paulis.size() == collection.termIndices.size());
+			for (size_t k = 0; k < collection.size(); ++k) {
+				REQUIRE(collection.paulis[k] == terms.pauli(collection.termIndices[k]));
+				++count[collection.termIndices[k]];
+			}
+		}
+		for (size_t i = 0; i < terms.size(); ++i) {
+			REQUIRE(count[i] == (terms.isActive(i) ? 1 : 0));
+		}
+	}
+}
+
+TEST_CASE("applyTPBGrouper equals the HT grouper with the edgeless graph") {
+	for (const auto* name : { "H6_bk.json", "H8_bk.json" }) {
+		const TermStore terms{ readHamiltonianFromJson(std::string{ DATA_PATH "hamiltonians/examples/" } + name) };
+		const std::vector<Graph<>> graphs{ Graph<>{ terms.numQubits() } };
+		GrouperOptions options;
+		options.verbose = false;
+
+		for (bool extractComputationalBasis : { false, true }) {
+			for (int numThreads : { 1, 3 }) {
+				const auto tpb = applyTPBGrouper(terms, numThreads, extractComputationalBasis);
+				const auto ht = applyPauliGrouper2Multithread2(terms, graphs, numThreads, extractComputationalBasis, options);
+				requireActiveTermsGroupedOnce(terms, tpb);
+				REQUIRE(tpb.size() == ht.size());
+				for (size_t i = 0; i < tpb.size(); ++i) {
+					REQUIRE(sorted(tpb[i].termIndices) == sorted(ht[i].termIndices));
+					REQUIRE(tpb[i].graph == ht[i].graph);
+					REQUIRE(tpb[i].singleQubitLayer == ht[i].singleQubitLayer);
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE("applySortedInsertion") {
+	Hamiltonian hamiltonian{ { { Pauli{ "XX" }, 1.0 }, { Pauli{ "ZZ" }, -0.9 }, { Pauli{ "XI" }, 0.8 }, { Pauli{ "ZI" }, 0.5 }, { Pauli{ "YY" }, 0.3 } }, 2 };
+	const TermStore terms{ hamiltonian };
+	const auto grouping = applySortedInsertion(terms);
+	REQUIRE(grouping.size() == 3);
+	REQUIRE(grouping[0].termIndices == std::vector<size_t>{ 0, 1, 4 });
+	REQUIRE(grouping[1].termIndices == std::vector<size_t>{ 2 });
+	REQUIRE(grouping[2].termIndices == std::vector<size_t>{ 3 });
+	REQUIRE(grouping[0].singleQubitLayer.empty());
+	requireActiveTermsGroupedOnce(terms, grouping);
+}
+
+TEST_CASE("applySortedInsertion on H6") {
+	TermStore terms{ readHamiltonianFromJson(DATA_PATH "hamiltonians/examples/H6_bk.json") };
+	terms.remove(0);
+	terms.remove(5);
+	const auto grouping = applySortedInsertion(terms);
+	requireActiveTermsGroupedOnce(terms, grouping);
+
+	for (const auto& collection : grouping) {
+		for (size_t k = 1; k < collection.size(); ++k) {
+			REQUIRE(commutesWithAll({ collection.paulis.begin(), collection.paulis.begin() + k }, collection.paulis[k]));
+		}
+	}
+	// each term joins the first group it commutes with
+	for (size_t i = 1; i < grouping.size(); ++i) {
+		const auto first = grouping[i].paulis[0];
+		for (size_t j = 0; j < i; ++j) {
+			std::vector<Pauli> before;
+			for (auto index : grouping[j].termIndices) {
+				if (index < grouping[i].termIndices[0]) before.push_back(terms.pauli(index));
+			}
+			REQUIRE_FALSE(commutesWithAll(before, first));
+		}
+	}
+
+	const auto parallel = applySortedInsertion(terms, 3);
+	REQUIRE(parallel.size() == grouping.size());
+	for (size_t i = 0; i < grouping.size(); ++i) {
+		REQUIRE(parallel[i].termIndices == grouping[i].termIndices);
+	}
+}
+
+TEST_CASE("applyChunkedGrouper passes on each collection once it is closed") {
+	const TermStore terms{ readHamiltonianFromJson(DATA_PATH "hamiltonians/examples/H6_bk.json") };
+	const ChunkGrouper groupChunk = [](TermStore chunk, double) { return applyTPBGrouper(chunk, 1, false); };
+	GrouperOptions options;
+	options.verbose = false;
+
+	for (size_t chunkSize : { size_t{ 7 }, size_t{ 50 }, terms.size() }) {
+		std::vector<CollectionWithGraph> closed;
+		applyChunkedGrouper(terms, chunkSize, groupChunk, [&](CollectionWithGraph collection) { closed.push_back(std::move(collection)); }, 2, true, options);
+		requireActiveTermsGroupedOnce(terms, closed);
+		REQUIRE(std::ranges::all_of(closed[0].termIndices, [&](size_t index) { return terms.x(index) == 0; }));
+		for (const auto& collection : closed) REQUIRE(collection.singleQubitLayer.size() == static_cast<size_t>(terms.numQubits()));
+
+		const auto collections = applyChunkedGrouper(terms, chunkSize, groupChunk, 2, true, options);
+		REQUIRE(collections.size() == closed.size());
+		for (size_t i = 0; i < closed.size(); ++i) {
+			REQUIRE(collections[i].termIndices == closed[i].termIndices);
+		}
+	}
+}
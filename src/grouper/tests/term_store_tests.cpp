@@ -0,0 +1,68 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "term_store.h"
+
+
+using namespace Q;
+
+namespace {
+	Hamiltonian smallHamiltonian() {
+		return Hamiltonian{ { { Pauli{ "XI" }, 0.5 }, { Pauli{ "ZZ" }, -2.0 }, { Pauli{ "IY" }, 1.0 }, { Pauli{ "YX" }, 1.0 } }, 2 };
+	}
+}
+
+TEST_CASE("TermStore order") {
+	const TermStore terms{ smallHamiltonian() };
+	REQUIRE(terms.size() == 4);
+	REQUIRE(terms.numQubits() == 2);
+
+	// sorted by the magnitude of the coefficients, ties keep their order
+	REQUIRE(terms.pauli(0) == Pauli{ "ZZ" });
+	REQUIRE(terms.pauli(1) == Pauli{ "IY" });
+	REQUIRE(terms.pauli(2) == Pauli{ "YX" });
+	REQUIRE(terms.pauli(3) == Pauli{ "XI" });
+	REQUIRE(terms.coefficient(0) == -2.0);
+	REQUIRE(terms.coefficient(3) == 0.5);
+
+	for (size_t i = 0; i < terms.size(); ++i) {
+		const auto pauli = terms.pauli(i);
+		REQUIRE(terms.x(i) == pauli.getXString());
+		REQUIRE(terms.z(i) == pauli.getZString());
+		REQUIRE(terms.support(i) == (pauli.getXString() | pauli.getZString()));
+		REQUIRE(terms.weight(i) == pauli.pauliWeight());
+	}
+}
+
+TEST_CASE("TermStore active terms") {
+	TermStore terms{ smallHamiltonian() };
+	REQUIRE(terms.numActive() == 4);
+	REQUIRE(terms.activeTerms() == std::vector<uint64_t>{ 0b1111 });
+
+	terms.remove(1);
+	terms.remove(1);
+	REQUIRE(terms.numActive() == 3);
+	REQUIRE_FALSE(terms.isActive(1));
+	REQUIRE(terms.nextActive(0) == 0);
+	REQUIRE(terms.nextActive(1) == 2);
+	terms.remove(2);
+	terms.remove(3);
+	REQUIRE(terms.nextActive(1) == TermStore::npos);
+
+	// bits beyond the last term are ignored
+	terms.setActiveTerms({ 0b110110 });
+	REQUIRE(terms.numActive() == 2);
+	REQUIRE(terms.activeTerms() == std::vector<uint64_t>{ 0b0110 });
+	REQUIRE_THROWS(terms.setActiveTerms({ 0, 0 }));
+}
+
+TEST_CASE("TermStore select") {
+	TermStore terms{ smallHamiltonian() };
+	terms.remove(0);
+	const auto selection = terms.select({ 1, 3 });
+	REQUIRE(selection.size() == 2);
+	REQUIRE(selection.numActive() == 2);
+	REQUIRE(selection.pauli(0) == terms.pauli(1));
+	REQUIRE(selection.pauli(1) == terms.pauli(3));
+	REQUIRE(selection.coefficient(1) == terms.coefficient(3));
+	REQUIRE_THROWS(terms.select({ 3, 1 }));
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "pauli.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace Q {
+
+	/// @brief Find the first set bit at or after the given position in a bitset stored as 64-bit words.
+	/// @param lastWord  Words from this one on are not searched
+	/// @return Index of the bit or npos if there is none
+	inline size_t findNextSetBit(const std::vector<uint64_t>& bits, size_t position, size_t lastWord = std::numeric_limits<size_t>::max()) {
+		constexpr auto npos = std::numeric_limits<size_t>::max();
+		const auto endWord = std::min(lastWord, bits.size());
+		auto word = position / 64;
+		if (word >= endWord) return npos;
+		auto current = bits[word] & (~0ULL << (position % 64));
+		while (current == 0) {
+			if (++word == endWord) return npos;
+			current = bits[word];
+		}
+		return word * 64 + std::countr_zero(current);
+	}
+
+
+	/// @brief Bit-packed N x N matrix that stores for each pair of Paulis whether they anticommute.
+	///
+	/// Row i holds a 1 at column j if Pauli i and Pauli j anticommute. The rows are computed from
+	/// separate arrays of the x and z strings so that the inner loop vectorizes well, optionally
+	/// distributed over a thread pool.
+	class AnticommutationMatrix {
+	public:
+		AnticommutationMatrix() = default;
+
+		explicit AnticommutationMatrix(const std::vector<Pauli>& paulis, ThreadPool* pool = nullptr)
+			: AnticommutationMatrix(xStrings(paulis), zStrings(paulis), pool) {}
+
+		/// @brief Compute the matrix from the X and Z components of the Paulis.
+		AnticommutationMatrix(const std::vector<uint64_t>& x, const std::vector<uint64_t>& z, ThreadPool* pool = nullptr)
+			: numPaulis(x.size()), wordsPerRow((x.size() + 63) / 64), bits(numPaulis * wordsPerRow) {
+
+			// Padded to whole words so that the inner loop has a fixed length
+			std::vector<uint64_t> xPadded(wordsPerRow * 64), zPadded(wordsPerRow * 64);
+			std::ranges::copy(x, xPadded.begin());
+			std::ranges::copy(z, zPadded.begin());
+
+			auto computeRows = [&](int, size_t first, size_t last) {
+				for (auto i = first; i < last; ++i) {
+					auto* r = &bits[i * wordsPerRow];
+					for (size_t w = 0; w < wordsPerRow; ++w) {
+						uint64_t word{};
+						for (size_t j = 0; j < 64; ++j) {
+							const auto k = w * 64 + j;
+							word |= static_cast<uint64_t>(std::popcount((xPadded[i] & zPadded[k]) ^ (zPadded[i] & xPadded[k])) & 1) << j;
+						}
+						r[w] = word;
+					}
+				}
+			};
+			if (pool) pool->parallelFor(numPaulis, 0, computeRows);
+			else computeRows(0, 0, numPaulis);
+		}
+
+		size_t size() const { return numPaulis; }
+		size_t numWords() const { return wordsPerRow; }
+
+		const uint64_t* row(size_t i) const { return &bits[i * wordsPerRow]; }
+
+		bool anticommute(size_t i, size_t j) const { return (row(i)[j / 64] >> (j % 64)) & 1; }
+
+		/// @brief Remove all Paulis that anticommute with Pauli i from the given bitset.
+		///        Only the words in [firstWord, lastWord) are updated.
+		/// @return Number of removed Paulis
+		size_t removeAnticommuting(std::vector<uint64_t>& set, size_t i, size_t firstWord = 0, size_t lastWord = std::numeric_limits<size_t>::max()) const {
+			const auto* r = row(i);
+			size_t removed{};
+			for (auto w = firstWord; w < std::min(lastWord, wordsPerRow); ++w) {
+				removed += std::popcount(set[w] & r[w]);
+				set[w] &= ~r[w];
+			}
+			return removed;
+		}
+
+	private:
+		size_t numPaulis{};
+		size_t wordsPerRow{};
+		std::vector<uint64_t> bits;
+
+		static std::vector<uint64_t> xStrings(const std::vector<Pauli>& paulis) {
+			std::vector<uint64_t> result;
+			for (const auto& pauli : paulis) result.push_back(pauli.getXString());
+			return result;
+		}
+
+		static std::vector<uint64_t> zStrings(const std::vector<Pauli>& paulis) {
+			std::vector<uint64_t> result;
+			for (const auto& pauli : paulis) result.push_back(pauli.getZString());
+			return result;
+		}
+	};
+
+}
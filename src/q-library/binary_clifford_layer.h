@@ -0,0 +1,82 @@
+#pragma once
+#include "pauli.h"
+#include "binary_pauli.h"
+
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace Q {
+
+	/// @brief Layer of single-qubit Clifford gates in bit-sliced form: qubit i applies the binary
+	///        matrix [[a_i, b_i], [c_i, d_i]], with bit i of a, b, c and d holding the entries.
+	///
+	/// This allows checking whether a Pauli is mapped into the stabilizer of a graph state with a
+	/// handful of bit operations per vertex.
+	struct BinaryCliffordLayer {
+		uint64_t a{};
+		uint64_t b{};
+		uint64_t c{};
+		uint64_t d{};
+
+		static constexpr BinaryCliffordLayer identity() {
+			return { ~0ULL, 0, 0, ~0ULL };
+		}
+
+		static BinaryCliffordLayer fromGates(const std::vector<BinaryCliffordGate>& gates) {
+			BinaryCliffordLayer layer;
+			for (int qubit = 0; qubit < static_cast<int>(gates.size()); ++qubit) {
+				layer.set(qubit, gates[qubit]);
+			}
+			return layer;
+		}
+
+		void set(int qubit, const BinaryCliffordGate& gate) {
+			const auto mask = 1ULL << qubit;
+			a = (a & ~mask) | (gate(0, 0).toInt() ? mask : 0);
+			b = (b & ~mask) | (gate(0, 1).toInt() ? mask : 0);
+			c = (c & ~mask) | (gate(1, 0).toInt() ? mask : 0);
+			d = (d & ~mask) | (gate(1, 1).toInt() ? mask : 0);
+		}
+
+		BinaryCliffordGate get(int qubit) const {
+			return BinaryCliffordGate{ ((a >> qubit) & 1) != 0, ((b >> qubit) & 1) != 0,
+				((c >> qubit) & 1) != 0, ((d >> qubit) & 1) != 0 };
+		}
+
+		/// @brief Take over the gates of the qubits in mask from another layer
+		void assign(const BinaryCliffordLayer& other, uint64_t mask) {
+			a = (a & ~mask) | (other.a & mask);
+			b = (b & ~mask) | (other.b & mask);
+			c = (c & ~mask) | (other.c & mask);
+			d = (d & ~mask) | (other.d & mask);
+		}
+
+		std::vector<BinaryCliffordGate> toGates(int numQubits) const {
+			std::vector<BinaryCliffordGate> gates(numQubits);
+			for (int qubit = 0; qubit < numQubits; ++qubit) gates[qubit] = get(qubit);
+			return gates;
+		}
+
+		/// @brief Find the vertices at which the transformed Pauli P' violates z'_i = ∑_{k ∈ N(i)} x'_k,
+		///        i.e. where P' fails to be in the stabilizer of the graph state.
+		/// @param pauli       Pauli operator to transform
+		/// @param neighbours  Adjacency rows of the graph (bit k of row i is set if i and k are connected)
+		/// @param support     Set of vertices to check
+		/// @return            Bit mask of the violated vertices
+		uint64_t violations(const Pauli& pauli, const std::vector<uint64_t>& neighbours, uint64_t support) const {
+			const auto x = pauli.getXString();
+			const auto z = pauli.getZString();
+			const auto xPrime = (a & x) ^ (b & z);
+			const auto zPrime = (c & x) ^ (d & z);
+			uint64_t violated{};
+			for (auto s = support; s; s &= s - 1) {
+				const int i = std::countr_zero(s);
+				const auto expected = static_cast<uint64_t>(std::popcount(xPrime & neighbours[i]) & 1);
+				if (expected != ((zPrime >> i) & 1)) violated |= (1ULL << i);
+			}
+			return violated;
+		}
+	};
+
+}
@@ -1,7 +1,10 @@
 ﻿#pragma once
+#ifdef WITH_GUROBI
 #include "gurobi_c++.h"
+#endif
 #include "graph.h"
 #include "binary_pauli.h"
+#include "native_ht_circuit_finder.h"
 
 #include <cassert>
 #include <optional>
@@ -14,7 +17,14 @@ namespace Q {
 	constexpr void qwe() { /**/ }
 
 
-	class HTCircuitFinder {
+	/// @brief Backend used by HTCircuitFinder. Auto uses Gurobi if it is available
+	///        and licensed and falls back to the native solver otherwise. 
+	enum class HTSolver { Auto, Native, Gurobi };
+
+
+#ifdef WITH_GUROBI
+
+	class GurobiHTCircuitFinder {
 		GRBEnv env{ true };
 		std::unique_ptr<GRBModel> model;
 
@@ -33,7 +43,7 @@ namespace Q {
 	public:
 
 
-		HTCircuitFinder(int numQubits, bool verbose = false) {
+		GurobiHTCircuitFinder(int numQubits, bool verbose = false) {
 			env.set(GRB_IntParam_OutputFlag, verbose);
 			env.set("LogFile", "mip1.log");
 			env.start();
@@ -44,10 +54,10 @@ namespace Q {
 			// Declare diagonal symbol matrices for blocks of symplectic matrix. 
 		}
 
-		HTCircuitFinder(const HTCircuitFinder&) = delete;
-		HTCircuitFinder& operator=(const HTCircuitFinder&) = delete;
-		HTCircuitFinder(HTCircuitFinder&&) = default;
-		HTCircuitFinder& operator=(HTCircuitFinder&&) = default;
+		GurobiHTCircuitFinder(const GurobiHTCircuitFinder&) = delete;
+		GurobiHTCircuitFinder& operator=(const GurobiHTCircuitFinder&) = delete;
+		GurobiHTCircuitFinder(GurobiHTCircuitFinder&&) = default;
+		GurobiHTCircuitFinder& operator=(GurobiHTCircuitFinder&&) = default;
 
 
 
@@ -203,7 +213,60 @@ namespace Q {
 
 	};
 
+#endif
 
 
-}
+	/// @brief Finds hardware-tailored single-qubit layers with the selected backend. 
+	class HTCircuitFinder {
+	public:
+		HTCircuitFinder(int numQubits, HTSolver solver = HTSolver::Auto, bool verbose = false) : native(numQubits) {
+#ifdef WITH_GUROBI
+			if (solver == HTSolver::Native) return;
+			try {
+				gurobi = std::make_unique<GurobiHTCircuitFinder>(numQubits, verbose);
+			}
+			catch (const GRBException& e) {
+				if (solver == HTSolver::Gurobi) throw std::runtime_error(std::format("Could not start Gurobi: {}", e.getMessage()));
+			}
+#else
+			if (solver == HTSolver::Gurobi) throw std::runtime_error("The Gurobi solver was requested but this build does not include Gurobi");
+#endif
+		}
 
+		bool usesGurobi() const {
+#ifdef WITH_GUROBI
+			return gurobi != nullptr;
+#else
+			return false;
+#endif
+		}
+
+		/// @brief Find a Local Clifford (if it exists) that rotates a given stabilizer into a given graph state |Γ〉. 
+		/// @param graph    Graph that describes the graph state |Γ〉
+		/// @param paulis   Stabilizer as a list of Pauli operators
+		/// @param verbose  If set to true, the generated equations are printed to stdout (Gurobi only)
+		/// @return         If successfull, a list of symplectic 2x2 matrices, corresponding to the 6 single-qubit Clifford gates
+		std::optional<std::vector<BinaryCliffordGate>> findHTCircuit(const Graph<>& graph, const std::vector<Pauli>& paulis, bool verbose = false) {
+#ifdef WITH_GUROBI
+			if (gurobi) return gurobi->findHTCircuit(graph, paulis, verbose);
+#endif
+			return native.findHTCircuit(graph, paulis);
+		}
+
+		/// @brief Same as above, but only considers the given qubits (typically a connected component of the graph). 
+		std::optional<std::vector<BinaryCliffordGate>> findHTCircuit(const Graph<>& graph, const std::vector<Pauli>& paulis, const std::vector<int>& qubits, bool verbose = false) {
+#ifdef WITH_GUROBI
+			if (gurobi) return gurobi->findHTCircuit(graph, paulis, qubits, verbose);
+#endif
+			return native.findHTCircuit(graph, paulis, qubits);
+		}
+
+	private:
+		NativeHTCircuitFinder native;
+#ifdef WITH_GUROBI
+		std::unique_ptr<GurobiHTCircuitFinder> gurobi;
+#endif
+	};
+
+
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include "binary_clifford_layer.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace Q {
+
+	/// @brief Thread-safe cache for the feasibility of a connected component of a graph and
+	///        a set of Paulis restricted to this component.
+	///
+	/// The key consists of the vertex mask of the component, its adjacency rows and the reduced
+	/// row echelon basis of the restricted Paulis (see makeKey()). The cache is split into shards
+	/// with one lock each so that concurrent workers rarely block each other. Each shard holds
+	/// two generations: when the current generation exceeds its share of the memory cap, it
+	/// replaces the previous one which is dropped. Entries found in the previous generation are
+	/// moved back to the current one, so frequently used entries survive.
+	class HTFeasibilityCache {
+	public:
+		using Key = std::vector<uint64_t>;
+
+		struct Entry {
+			bool feasible{};
+			BinaryCliffordLayer layer; // only the bits of the component are meaningful
+		};
+
+		struct Statistics {
+			uint64_t hits{};
+			uint64_t misses{};
+			uint64_t evictions{};
+		};
+
+		/// @param maxBytes Approximate upper bound for the memory used by the cached entries
+		explicit HTFeasibilityCache(size_t maxBytes = 256ULL << 20) : maxBytesPerShard(maxBytes / numShards) {}
+
+		/// @brief Build the cache key for the Paulis restricted to a connected component.
+		/// @param key           Output, reused to avoid allocations
+		/// @param vertexMask    Vertices of the component
+		/// @param neighbours    Adjacency rows of the whole graph
+		/// @param paulis        Paulis (only the components on vertexMask are considered)
+		/// @param rows          Scratch buffer for the elimination
+		static void makeKey(Key& key, uint64_t vertexMask, const std::vector<uint64_t>& neighbours, const std::vector<Pauli>& paulis, std::vector<std::array<uint64_t, 2>>& rows) {
+			key.clear();
+			key.push_back(vertexMask);
+			for (auto m = vertexMask; m; m &= m - 1) {
+				key.push_back(neighbours[std::countr_zero(m)] & vertexMask);
+			}
+
+			// Reduced row echelon form with the pivot being the lowest set bit of (x|z)
+			rows.clear();
+			for (const auto& pauli : paulis) {
+				std::array<uint64_t, 2> row{ pauli.getXString() & vertexMask, pauli.getZString() & vertexMask };
+				for (const auto& other : rows) {
+					if (hasBit(row, pivot(other))) {
+						row[0] ^= other[0];
+						row[1] ^= other[1];
+					}
+				}
+				if ((row[0] | row[1]) == 0) continue;
+				const int p = pivot(row);
+				for (auto& other : rows) {
+					if (hasBit(other, p)) {
+						other[0] ^= row[0];
+						other[1] ^= row[1];
+					}
+				}
+				rows.push_back(row);
+			}
+			std::ranges::sort(rows, std::less{}, [](const auto& row) { return pivot(row); });
+			for (const auto& row : rows) {
+				key.push_back(row[0]);
+				key.push_back(row[1]);
+			}
+		}
+
+		std::optional<Entry> find(const Key& key) {
+			auto& shard = shardFor(key);
+			std::lock_guard lock{ shard.mutex };
+			if (auto it = shard.current.find(key); it != shard.current.end()) {
+				hits.fetch_add(1, std::memory_order_relaxed);
+				return it->second;
+			}
+			if (auto it = shard.previous.find(key); it != shard.previous.end()) {
+				hits.fetch_add(1, std::memory_order_relaxed);
+				auto entry = it->second;
+				auto node = shard.previous.extract(it);
+				shard.previousBytes -= entryBytes(node.key());
+				shard.currentBytes += entryBytes(node.key());
+				shard.current.insert(std::move(node));
+				evictIfFull(shard);
+				return entry;
+			}
+			misses.fetch_add(1, std::memory_order_relaxed);
+			return std::nullopt;
+		}
+
+		void insert(const Key& key, const Entry& entry) {
+			if (maxBytesPerShard == 0) return;
+			auto& shard = shardFor(key);
+			std::lock_guard lock{ shard.mutex };
+			if (shard.current.try_emplace(key, entry).second) {
+				shard.currentBytes += entryBytes(key);
+				evictIfFull(shard);
+			}
+		}
+
+		Statistics statistics() const {
+			return { hits.load(std::memory_order_relaxed), misses.load(std::memory_order_relaxed), evictions.load(std::memory_order_relaxed) };
+		}
+
+		/// @brief Memory bound the cache was created with
+		size_t maxBytes() const { return maxBytesPerShard * numShards; }
+
+		size_t size() const {
+			size_t total{};
+			for (auto& shard : shards) {
+				std::lock_guard lock{ shard.mutex };
+				total += shard.current.size() + shard.previous.size();
+			}
+			return total;
+		}
+
+	private:
+		struct KeyHash {
+			size_t operator()(const Key& key) const {
+				uint64_t h = 0x9e3779b97f4a7c15ULL;
+				for (auto word : key) {
+					h ^= word + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+				}
+				return static_cast<size_t>(h * 0xff51afd7ed558ccdULL);
+			}
+		};
+
+		using Map = std::unordered_map<Key, Entry, KeyHash>;
+
+		struct alignas(64) Shard {
+			mutable std::mutex mutex;
+			Map current;
+			Map previous;
+			size_t currentBytes{};
+			size_t previousBytes{};
+		};
+
+		static constexpr size_t numShards = 64;
+
+		size_t maxBytesPerShard;
+		std::array<Shard, numShards> shards;
+		std::atomic<uint64_t> hits{};
+		std::atomic<uint64_t> misses{};
+		std::atomic<uint64_t> evictions{};
+
+		static constexpr int pivot(const std::array<uint64_t, 2>& row) {
+			return row[0] ? std::countr_zero(row[0]) : 64 + std::countr_zero(row[1]);
+		}
+
+		static constexpr bool hasBit(const std::array<uint64_t, 2>& row, int bit) {
+			return bit < 64 ? (row[0] >> bit) & 1 : (row[1] >> (bit - 64)) & 1;
+		}
+
+		static constexpr size_t entryBytes(const Key& key) {
+			// key data plus a rough estimate for the node and bucket overhead
+			return key.size() * sizeof(uint64_t) + sizeof(Key) + sizeof(Entry) + 32;
+		}
+
+		Shard& shardFor(const Key& key) {
+			return shards[(KeyHash{}(key) >> 58) % numShards];
+		}
+
+		void evictIfFull(Shard& shard) {
+			if (shard.currentBytes <= maxBytesPerShard / 2) return;
+			evictions.fetch_add(shard.previous.size(), std::memory_order_relaxed);
+			shard.previous = std::move(shard.current);
+			shard.previousBytes = shard.currentBytes;
+			shard.current = Map{};
+			shard.currentBytes = 0;
+		}
+	};
+
+}
@@ -0,0 +1,256 @@
+#pragma once
+#include "stabilizer.h"
+#include "pauli.h"
+#include "binary_clifford_layer.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Q {
+
+	namespace detail {
+		constexpr int numGates = 6;
+		constexpr int numPairs(int k) { return k * (k - 1) / 2; }
+		// Index of the edge (i,j) with i < j in the edge mask
+		constexpr int pairIndex(int i, int j) { return j * (j - 1) / 2 + i; }
+		constexpr int numLayers(int k) { int result = 1; for (int i = 0; i < k; ++i) result *= numGates; return result; }
+		constexpr int numWords(int k) { return (numLayers(k) + 63) / 64; }
+		constexpr size_t tableSize(int k) { return (size_t{ 1 } << (2 * k)) * numWords(k); }
+		// Position of the first table with k vertices in the list of all labeled graphs
+		constexpr size_t slotOffset(int k) { size_t offset{}; for (int j = 1; j < k; ++j) offset += size_t{ 1 } << numPairs(j); return offset; }
+	}
+
+	/// @brief Precomputed feasibility tables for connected components with up to five vertices.
+	///
+	/// For a graph with k vertices there are 6^k layers of single-qubit Cliffords. For each of the
+	/// 4^k Paulis on k qubits, the table stores a bit mask over all layers that map this Pauli into
+	/// the stabilizer of the graph state. A set of Paulis is then diagonalizable with the graph
+	/// exactly when the AND of the masks of its members is not zero, and any set bit of the result
+	/// identifies a suitable layer.
+	///
+	/// Tables are built from getStabilizer() on first use for each labeled graph and can be saved
+	/// to and loaded from a binary file.
+	class HTLayerTables {
+	public:
+		static constexpr int maxVertices = 5;
+		static constexpr int numGates = detail::numGates;
+
+		HTLayerTables() = default;
+		HTLayerTables(const HTLayerTables&) = delete;
+		HTLayerTables& operator=(const HTLayerTables&) = delete;
+
+		/// @brief Find a layer that maps the Paulis restricted to the given vertices into the stabilizer
+		///        of the graph state on these vertices.
+		/// @param paulis      Paulis to diagonalize
+		/// @param vertices    Vertices of the component (at most maxVertices)
+		/// @param neighbours  Adjacency rows of the whole graph
+		/// @param layer       Receives the gates of the given vertices on success
+		/// @return            success
+		bool findLayer(const std::vector<Pauli>& paulis, const std::vector<int>& vertices, const std::vector<uint64_t>& neighbours, BinaryCliffordLayer& layer) {
+			const int k = static_cast<int>(vertices.size());
+			uint32_t edgeMask{};
+			for (int i = 0; i < k; ++i) {
+				for (int j = i + 1; j < k; ++j) {
+					if ((neighbours[vertices[i]] >> vertices[j]) & 1) edgeMask |= 1U << detail::pairIndex(i, j);
+				}
+			}
+			const auto& masks = table(k, edgeMask);
+			const int words = detail::numWords(k);
+
+			std::array<uint64_t, detail::numWords(maxVertices)> result;
+			std::fill_n(result.begin(), words, ~0ULL);
+			for (const auto& pauli : paulis) {
+				const auto* mask = &masks[static_cast<size_t>(localIndex(pauli, vertices)) * words];
+				uint64_t any{};
+				for (int w = 0; w < words; ++w) any |= (result[w] &= mask[w]);
+				if (any == 0) return false;
+			}
+
+			for (int w = 0; w < words; ++w) {
+				if (result[w] == 0) continue;
+				int code = w * 64 + std::countr_zero(result[w]);
+				for (int i = 0; i < k; ++i, code /= numGates) {
+					layer.set(vertices[i], gates[code % numGates]);
+				}
+				return true;
+			}
+			return false;
+		}
+
+		/// @brief Number of tables that have been built or loaded so far
+		size_t size() const {
+			std::lock_guard lock{ mutex };
+			return tables.size();
+		}
+
+		/// @brief Write all tables that have been built so far to a binary file.
+		void save(const std::string& filename) const {
+			std::lock_guard lock{ mutex };
+			std::ofstream file{ filename, std::ios::binary };
+			if (!file) throw std::runtime_error("Could not open layer table file \"" + filename + "\" for writing");
+			write(file, magic);
+			write(file, static_cast<uint32_t>(tables.size()));
+			for (const auto& table : tables) {
+				write(file, static_cast<uint32_t>(table->numVertices));
+				write(file, table->edgeMask);
+				file.write(reinterpret_cast<const char*>(table->masks.data()), static_cast<std::streamsize>(table->masks.size() * sizeof(uint64_t)));
+			}
+		}
+
+		/// @brief Load tables from a binary file written by save().
+		void load(const std::string& filename) {
+			std::ifstream file{ filename, std::ios::binary };
+			if (!file) throw std::runtime_error("Could not open layer table file \"" + filename + "\"");
+			auto invalid = [&] { return std::runtime_error("Invalid layer table file \"" + filename + "\""); };
+			if (read<uint32_t>(file) != magic) throw invalid();
+			const auto count = read<uint32_t>(file);
+			for (uint32_t t = 0; t < count; ++t) {
+				auto table = std::make_unique<Table>();
+				table->numVertices = static_cast<int>(read<uint32_t>(file));
+				table->edgeMask = read<uint32_t>(file);
+				if (!file || table->numVertices < 1 || table->numVertices > maxVertices || table->edgeMask >= (1U << detail::numPairs(table->numVertices))) throw invalid();
+				table->masks.resize(detail::tableSize(table->numVertices));
+				file.read(reinterpret_cast<char*>(table->masks.data()), static_cast<std::streamsize>(table->masks.size() * sizeof(uint64_t)));
+				if (!file) throw invalid();
+				publish(std::move(table));
+			}
+		}
+
+	private:
+		struct Table {
+			int numVertices{};
+			uint32_t edgeMask{};
+			std::vector<uint64_t> masks; // [pauli][word]
+		};
+
+		static constexpr uint32_t magic = 0x544c5448; // "HTLT"
+
+		// Same order as in NativeHTCircuitFinder: I, H, S, HS, SH, HSH
+		static constexpr std::array<BinaryCliffordGate, numGates> gates{
+			BinaryCliffordGates::I, BinaryCliffordGates::H, BinaryCliffordGates::S,
+			BinaryCliffordGates::HS, BinaryCliffordGates::SH, BinaryCliffordGates::HSH
+		};
+
+		static constexpr size_t numSlots = detail::slotOffset(maxVertices + 1);
+
+		mutable std::mutex mutex;
+		std::vector<std::unique_ptr<Table>> tables;
+		std::array<std::atomic<const Table*>, numSlots> slots{};
+
+		/// @brief Index of the Pauli restricted to the vertices: bit i holds x and bit k + i holds z of vertex i.
+		static uint32_t localIndex(const Pauli& pauli, const std::vector<int>& vertices) {
+			const int k = static_cast<int>(vertices.size());
+			uint32_t index{};
+			for (int i = 0; i < k; ++i) {
+				index |= static_cast<uint32_t>(pauli.x(vertices[i]) << i);
+				index |= static_cast<uint32_t>(pauli.z(vertices[i]) << (k + i));
+			}
+			return index;
+		}
+
+		const std::vector<uint64_t>& table(int k, uint32_t edgeMask) {
+			auto& slot = slots[detail::slotOffset(k) + edgeMask];
+			if (const auto* table = slot.load(std::memory_order_acquire)) return table->masks;
+
+			auto table = build(k, edgeMask);
+			return publish(std::move(table))->masks;
+		}
+
+		const Table* publish(std::unique_ptr<Table> table) {
+			std::lock_guard lock{ mutex };
+			auto& slot = slots[detail::slotOffset(table->numVertices) + table->edgeMask];
+			if (const auto* existing = slot.load(std::memory_order_relaxed)) return existing;
+			tables.push_back(std::move(table));
+			slot.store(tables.back().get(), std::memory_order_release);
+			return tables.back().get();
+		}
+
+		static std::unique_ptr<Table> build(int k, uint32_t edgeMask) {
+			switch (k) {
+			case 1: return build<1>(edgeMask);
+			case 2: return build<2>(edgeMask);
+			case 3: return build<3>(edgeMask);
+			case 4: return build<4>(edgeMask);
+			case 5: return build<5>(edgeMask);
+			}
+			throw std::invalid_argument("Layer tables are only available for up to five vertices");
+		}
+
+		template<int k>
+		static std::unique_ptr<Table> build(uint32_t edgeMask) {
+			Graph<k> graph;
+			for (int j = 0; j < k; ++j) {
+				for (int i = 0; i < j; ++i) {
+					if (edgeMask & (1U << detail::pairIndex(i, j))) graph.addEdge(i, j);
+				}
+			}
+
+			// All 2^k elements of the stabilizer (phases are irrelevant here). getStabilizer() uses the 
+			// generators Z_i X_N(i) while the HT circuits target X_i Z_N(i), so x and z are swapped. 
+			const auto generators = getStabilizer<k>(graph);
+			std::vector<std::array<uint64_t, 2>> stabilizer;
+			for (uint32_t subset = 0; subset < (1U << k); ++subset) {
+				std::array<uint64_t, 2> element{};
+				for (int i = 0; i < k; ++i) {
+					if (!(subset & (1U << i))) continue;
+					element[0] ^= generators[i].getZString();
+					element[1] ^= generators[i].getXString();
+				}
+				stabilizer.push_back(element);
+			}
+
+			// preimage[g][p]: single-qubit Pauli (x + 2z) that gate g maps to p
+			std::array<std::array<int, 4>, numGates> preimage{};
+			for (int g = 0; g < numGates; ++g) {
+				for (int p = 0; p < 4; ++p) {
+					const int x = p & 1, z = p >> 1;
+					const int image = ((gates[g](0, 0).toInt() & x) ^ (gates[g](0, 1).toInt() & z)) + 2 * ((gates[g](1, 0).toInt() & x) ^ (gates[g](1, 1).toInt() & z));
+					preimage[g][image] = p;
+				}
+			}
+
+			auto table = std::make_unique<Table>();
+			table->numVertices = k;
+			table->edgeMask = edgeMask;
+			table->masks.resize(detail::tableSize(k));
+			const int words = detail::numWords(k);
+
+			std::array<int, k> layer{};
+			for (int code = 0; code < detail::numLayers(k); ++code) {
+				for (int i = 0, c = code; i < k; ++i, c /= numGates) layer[i] = c % numGates;
+				for (const auto& [x, z] : stabilizer) {
+					uint32_t index{};
+					for (int i = 0; i < k; ++i) {
+						const int p = preimage[layer[i]][((x >> i) & 1) + 2 * ((z >> i) & 1)];
+						index |= static_cast<uint32_t>(p & 1) << i;
+						index |= static_cast<uint32_t>(p >> 1) << (k + i);
+					}
+					table->masks[static_cast<size_t>(index) * words + code / 64] |= 1ULL << (code % 64);
+				}
+			}
+			return table;
+		}
+
+		template<class T>
+		static void write(std::ofstream& file, T value) {
+			file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template<class T>
+		static T read(std::ifstream& file) {
+			T value{};
+			file.read(reinterpret_cast<char*>(&value), sizeof(T));
+			return value;
+		}
+	};
+
+}
@@ -0,0 +1,263 @@
+#pragma once
+#include "graph.h"
+#include "pauli.h"
+#include "binary_pauli.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace Q {
+
+	/// @brief Exact solver for the hardware-tailored circuit problem that works directly on
+	///        the binary representation of the Paulis and the graph.
+	///
+	/// With the single-qubit Clifford of qubit k written as the binary matrix [[a_k, b_k], [c_k, d_k]],
+	/// the transformed Paulis are in the stabilizer of the graph state |Γ〉 iff for every vertex i
+	/// and every Pauli
+	///
+	///     c_i x_i + d_i z_i + ∑_{k ∈ N(i)} (a_k x_k + b_k z_k) = 0   (mod 2).
+	///
+	/// This is linear in the 4n gate variables. The only non-linear condition is that each gate is
+	/// invertible, i.e. one of the 6 single-qubit Cliffords. The solver keeps the linear system in
+	/// reduced row echelon form and branches on the gate of one vertex at a time (smallest domain
+	/// first), adding the four gate entries as unit equations.
+	class NativeHTCircuitFinder {
+	public:
+		explicit NativeHTCircuitFinder(int numQubits = 0) {
+			resize(numQubits);
+		}
+
+		/// @brief Find a Local Clifford (if it exists) that rotates a given stabilizer into a given graph state |Γ〉.
+		/// @param graph    Graph that describes the graph state |Γ〉
+		/// @param paulis   Stabilizer as a list of Pauli operators
+		/// @return         If successfull, a list of symplectic 2x2 matrices, corresponding to the 6 single-qubit Clifford gates
+		std::optional<std::vector<BinaryCliffordGate>> findHTCircuit(const Graph<>& graph, const std::vector<Pauli>& paulis) {
+			resize(graph.numVertices());
+			for (int i = 0; i < numVertices; ++i) {
+				neighbours[i] = 0;
+				for (int k = 0; k < numVertices; ++k) {
+					if (graph.hasEdge(i, k)) neighbours[i] |= (1ULL << k);
+				}
+			}
+			return solve(paulis, nullptr);
+		}
+
+		/// @brief Find a Local Clifford (if it exists) that rotates a given stabilizer into the graph state |Γ〉
+		///        restricted to the given qubits.
+		/// @param graph    Graph that describes the graph state |Γ〉
+		/// @param paulis   Stabilizer as a list of Pauli operators
+		/// @param qubits   Subset of the qubits to consider (typically a connected component of the graph)
+		/// @return         If successfull, a list of symplectic 2x2 matrices for the given qubits (in the given order)
+		std::optional<std::vector<BinaryCliffordGate>> findHTCircuit(const Graph<>& graph, const std::vector<Pauli>& paulis, const std::vector<int>& qubits) {
+			resize(static_cast<int>(qubits.size()));
+			for (int i = 0; i < numVertices; ++i) {
+				neighbours[i] = 0;
+				for (int k = 0; k < numVertices; ++k) {
+					if (graph.hasEdge(qubits[i], qubits[k])) neighbours[i] |= (1ULL << k);
+				}
+			}
+			return solve(paulis, qubits.data());
+		}
+
+	private:
+		// The 6 single-qubit Cliffords as (a,b,c,d), see BinaryCliffordGates
+		static constexpr std::array<std::array<int, 4>, 6> gates{ {
+			{1,0,0,1}, {0,1,1,0}, {1,0,1,1}, {1,1,1,0}, {0,1,1,1}, {1,1,0,1}
+		} };
+		static constexpr int numGates = 6;
+
+		int numVertices{};
+		int numVars{};    // 4 per vertex: a, b, c, d
+		int numWords{};   // words per equation, the bit after the variables holds the right hand side
+		std::vector<uint64_t> neighbours;
+
+		// One linear system in reduced row echelon form per search depth
+		std::vector<uint64_t> matrices;    // [depth][row][word]
+		std::vector<int> pivotRows;        // [depth][variable]: row with this pivot or -1
+		std::vector<int> rowPivots;        // [depth][row]: pivot variable of the row
+		std::vector<int> ranks;            // [depth]
+		std::vector<int> assignedGates;    // [vertex], -1 if not assigned yet
+		std::vector<uint64_t> scratch;
+
+		void resize(int n) {
+			numVertices = n;
+			numVars = 4 * n;
+			numWords = (numVars + 1 + 63) / 64;
+			neighbours.resize(n);
+			const auto levels = static_cast<size_t>(n + 1);
+			matrices.resize(levels * numVars * numWords);
+			pivotRows.resize(levels * numVars);
+			rowPivots.resize(levels * numVars);
+			ranks.resize(levels);
+			assignedGates.resize(n);
+			scratch.resize(numWords);
+		}
+
+		uint64_t* equation(int depth, int row) { return &matrices[(static_cast<size_t>(depth) * numVars + row) * numWords]; }
+		int* pivots(int depth) { return &pivotRows[static_cast<size_t>(depth) * numVars]; }
+		int* rowPivot(int depth) { return &rowPivots[static_cast<size_t>(depth) * numVars]; }
+
+		static bool bit(const uint64_t* row, int index) { return (row[index / 64] >> (index % 64)) & 1; }
+		static void setBit(uint64_t* row, int index) { row[index / 64] ^= (1ULL << (index % 64)); }
+		void addTo(uint64_t* target, const uint64_t* source) const { for (int w = 0; w < numWords; ++w) target[w] ^= source[w]; }
+
+		int firstVariable(const uint64_t* row) const {
+			for (int w = 0; w < numWords; ++w) {
+				auto word = row[w];
+				if (w == numVars / 64) word &= (1ULL << (numVars % 64)) - 1; // mask out the right hand side
+				if (word) return w * 64 + std::countr_zero(word);
+				if (w == numVars / 64) break;
+			}
+			return -1;
+		}
+
+		/// @brief Add an equation to the system at the given depth.
+		/// @return false if the system became inconsistent
+		bool insert(int depth, uint64_t* row) {
+			auto* pivot = pivots(depth);
+			auto* pivotOfRow = rowPivot(depth);
+			int& rank = ranks[depth];
+			for (int r = 0; r < rank; ++r) {
+				if (bit(row, pivotOfRow[r])) addTo(row, equation(depth, r));
+			}
+			const int p = firstVariable(row);
+			if (p == -1) return !bit(row, numVars);
+
+			for (int r = 0; r < rank; ++r) {
+				auto* other = equation(depth, r);
+				if (bit(other, p)) addTo(other, row);
+			}
+			std::copy_n(row, numWords, equation(depth, rank));
+			pivotOfRow[rank] = p;
+			pivot[p] = rank++;
+			return true;
+		}
+
+		/// @brief Get the set of gates for the given vertex that are consistent with the linear system
+		///        at the given depth as bit mask.
+		int domain(int depth, int vertex) {
+			// Reduce the unit equations for the 4 gate variables (rhs 0 for now)
+			std::array<uint64_t, 4 * 5> reduced{};
+			const auto* pivot = pivots(depth);
+			for (int t = 0; t < 4; ++t) {
+				auto* row = &reduced[t * numWords];
+				const int variable = 4 * vertex + t;
+				if (pivot[variable] == -1) {
+					setBit(row, variable);
+				}
+				else {
+					addTo(row, equation(depth, pivot[variable]));
+					setBit(row, variable);
+				}
+			}
+			// Find dependencies between the reduced equations. A dependency (set of t's summing
+			// to zero in the variables) requires the gate entries to match its right hand side.
+			std::array<int, 4> combination{ 1, 2, 4, 8 };
+			int dependencyMasks[4]{}, dependencyRhs[4]{}, numDependencies{};
+			for (int t = 0; t < 4; ++t) {
+				auto* row = &reduced[t * numWords];
+				const int p = firstVariable(row);
+				if (p == -1) {
+					dependencyMasks[numDependencies] = combination[t];
+					dependencyRhs[numDependencies++] = bit(row, numVars);
+					continue;
+				}
+				for (int s = t + 1; s < 4; ++s) {
+					auto* other = &reduced[s * numWords];
+					if (bit(other, p)) {
+						addTo(other, row);
+						combination[s] ^= combination[t];
+					}
+				}
+			}
+			int mask{};
+			for (int g = 0; g < numGates; ++g) {
+				bool consistent = true;
+				for (int d = 0; d < numDependencies && consistent; ++d) {
+					int parity = dependencyRhs[d];
+					for (int t = 0; t < 4; ++t) {
+						if (dependencyMasks[d] & (1 << t)) parity ^= gates[g][t];
+					}
+					consistent = parity == 0;
+				}
+				if (consistent) mask |= (1 << g);
+			}
+			return mask;
+		}
+
+		std::optional<std::vector<BinaryCliffordGate>> solve(const std::vector<Pauli>& paulis, const int* qubits) {
+			std::fill_n(pivots(0), numVars, -1);
+			ranks[0] = 0;
+			std::fill(assignedGates.begin(), assignedGates.end(), -1);
+
+			auto* row = scratch.data();
+			for (const auto& pauli : paulis) {
+				for (int i = 0; i < numVertices; ++i) {
+					std::fill_n(row, numWords, 0);
+					const int qubit = qubits ? qubits[i] : i;
+					if (pauli.x(qubit)) setBit(row, 4 * i + 2);
+					if (pauli.z(qubit)) setBit(row, 4 * i + 3);
+					for (auto n = neighbours[i]; n; n &= n - 1) {
+						const int k = std::countr_zero(n);
+						const int neighbour = qubits ? qubits[k] : k;
+						if (pauli.x(neighbour)) setBit(row, 4 * k + 0);
+						if (pauli.z(neighbour)) setBit(row, 4 * k + 1);
+					}
+					insert(0, row);
+				}
+				// Only the zero solution is left which is not invertible
+				if (ranks[0] == numVars) return std::nullopt;
+			}
+
+			if (!search(0)) return std::nullopt;
+
+			std::vector<BinaryCliffordGate> singleQubitLayer(numVertices);
+			for (int i = 0; i < numVertices; ++i) {
+				const auto& [a, b, c, d] = gates[assignedGates[i]];
+				singleQubitLayer[i] = BinaryCliffordGate{ a != 0, b != 0, c != 0, d != 0 };
+			}
+			return singleQubitLayer;
+		}
+
+		bool search(int depth) {
+			// Choose the unassigned vertex with the smallest domain
+			int vertex{ -1 }, vertexDomain{}, best{ numGates + 1 };
+			for (int u = 0; u < numVertices; ++u) {
+				if (assignedGates[u] != -1) continue;
+				const int d = domain(depth, u);
+				if (d == 0) return false;
+				if (std::popcount(static_cast<unsigned>(d)) < best) {
+					best = std::popcount(static_cast<unsigned>(d));
+					vertex = u;
+					vertexDomain = d;
+				}
+			}
+			if (vertex == -1) return true;
+
+			auto* row = scratch.data();
+			for (int g = 0; g < numGates; ++g) {
+				if (!(vertexDomain & (1 << g))) continue;
+
+				std::copy_n(equation(depth, 0), static_cast<size_t>(ranks[depth]) * numWords, equation(depth + 1, 0));
+				std::copy_n(pivots(depth), numVars, pivots(depth + 1));
+				std::copy_n(rowPivot(depth), ranks[depth], rowPivot(depth + 1));
+				ranks[depth + 1] = ranks[depth];
+				for (int t = 0; t < 4; ++t) {
+					std::fill_n(row, numWords, 0);
+					setBit(row, 4 * vertex + t);
+					if (gates[g][t]) setBit(row, numVars);
+					insert(depth + 1, row);
+				}
+				assignedGates[vertex] = g;
+				if (search(depth + 1)) return true;
+				assignedGates[vertex] = -1;
+			}
+			return false;
+		}
+	};
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "pauli.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace Q {
+
+	/// @brief Incremental GF(2) basis of the span of a set of Pauli operators (ignoring phases).
+	///
+	/// Each Pauli is treated as the binary vector (x|z). The basis is kept in reduced row echelon
+	/// form, i.e. every pivot bit is set in exactly one basis row. This makes membership tests a
+	/// single pass over the basis and gives a canonical representation of the span.
+	class PauliSpan {
+	public:
+		struct Row {
+			uint64_t x{};
+			uint64_t z{};
+			int pivot{};   // 0-63: bit in x, 64-127: bit in z
+
+			constexpr friend bool operator==(const Row&, const Row&) = default;
+		};
+
+		/// @brief Add a Pauli to the span.
+		/// @return true if the Pauli was linearly independent of the previous ones and extended the span.
+		bool insert(const Pauli& pauli) {
+			auto row = reduce(pauli.getXString(), pauli.getZString());
+			if (row.x == 0 && row.z == 0) return false;
+
+			row.pivot = row.x ? std::countr_zero(row.x) : 64 + std::countr_zero(row.z);
+			for (auto& other : rows) {
+				if (hasBit(other, row.pivot)) {
+					other.x ^= row.x;
+					other.z ^= row.z;
+				}
+			}
+			auto position = std::ranges::upper_bound(rows, row.pivot, std::less{}, &Row::pivot);
+			rows.insert(position, row);
+			return true;
+		}
+
+		/// @brief Check if a Pauli is a product of the Paulis in the span (up to phase).
+		bool contains(const Pauli& pauli) const {
+			auto row = reduce(pauli.getXString(), pauli.getZString());
+			return row.x == 0 && row.z == 0;
+		}
+
+		/// @brief Number of independent generators
+		size_t rank() const { return rows.size(); }
+
+		/// @brief Basis rows in reduced row echelon form, sorted by pivot.
+		const std::vector<Row>& basis() const { return rows; }
+
+		void clear() { rows.clear(); }
+
+	private:
+		std::vector<Row> rows;
+
+		static constexpr bool hasBit(const Row& row, int bit) {
+			return bit < 64 ? (row.x >> bit) & 1 : (row.z >> (bit - 64)) & 1;
+		}
+
+		Row reduce(uint64_t x, uint64_t z) const {
+			Row row{ x, z };
+			for (const auto& other : rows) {
+				if (hasBit(row, other.pivot)) {
+					row.x ^= other.x;
+					row.z ^= other.z;
+				}
+			}
+			return row;
+		}
+	};
+
+}
@@ -0,0 +1,62 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "anticommutation_matrix.h"
+#include <random>
+
+
+using namespace Q;
+
+namespace {
+	std::vector<Pauli> randomPaulis(size_t count, int numQubits) {
+		std::mt19937_64 generator{ 42 };
+		std::vector<Pauli> paulis;
+		for (size_t i = 0; i < count; ++i) {
+			Pauli pauli{ numQubits };
+			for (int q = 0; q < numQubits; ++q) {
+				pauli.setX(q, generator() & 1);
+				pauli.setZ(q, generator() & 1);
+			}
+			paulis.push_back(pauli);
+		}
+		return paulis;
+	}
+}
+
+TEST_CASE("AnticommutationMatrix") {
+	const auto paulis = randomPaulis(150, 7);
+	const AnticommutationMatrix matrix{ paulis };
+	REQUIRE(matrix.size() == 150);
+	REQUIRE(matrix.numWords() == 3);
+	for (size_t i = 0; i < paulis.size(); ++i) {
+		for (size_t j = 0; j < paulis.size(); ++j) {
+			REQUIRE(matrix.anticommute(i, j) == (commutator(paulis[i], paulis[j]) == 1));
+		}
+		// no bits beyond the last Pauli
+		REQUIRE(matrix.row(i)[2] >> (150 - 128) == 0);
+	}
+
+	ThreadPool pool{ 3 };
+	const AnticommutationMatrix parallelMatrix{ paulis, &pool };
+	for (size_t i = 0; i < paulis.size(); ++i) {
+		REQUIRE(std::equal(matrix.row(i), matrix.row(i) + 3, parallelMatrix.row(i)));
+	}
+}
+
+TEST_CASE("AnticommutationMatrix removeAnticommuting") {
+	const AnticommutationMatrix matrix{ { Pauli{ "XX" }, Pauli{ "ZI" }, Pauli{ "ZZ" }, Pauli{ "IX" } } };
+	std::vector<uint64_t> set{ 0b1111 };
+	REQUIRE(matrix.removeAnticommuting(set, 1) == 1);
+	REQUIRE(set[0] == 0b1110);
+	REQUIRE(matrix.removeAnticommuting(set, 3) == 1);
+	REQUIRE(set[0] == 0b1010);
+}
+
+TEST_CASE("findNextSetBit") {
+	constexpr auto npos = std::numeric_limits<size_t>::max();
+	std::vector<uint64_t> bits{ 0b1001, 0, 1ULL << 63 };
+	REQUIRE(findNextSetBit(bits, 0) == 0);
+	REQUIRE(findNextSetBit(bits, 1) == 3);
+	REQUIRE(findNextSetBit(bits, 4) == 191);
+	REQUIRE(findNextSetBit(bits, 4, 2) == npos);
+	REQUIRE(findNextSetBit(bits, 192) == npos);
+}
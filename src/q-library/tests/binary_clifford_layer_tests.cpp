@@ -0,0 +1,21 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "binary_clifford_layer.h"
+#include "native_ht_circuit_finder.h"
+
+
+using namespace Q;
+
+TEST_CASE("BinaryCliffordLayer violations") {
+	NativeHTCircuitFinder finder{ 3 };
+	auto graph = Graph<>::linear(3);
+	std::vector<uint64_t> neighbours{ 0b010, 0b101, 0b010 };
+	auto result = finder.findHTCircuit(graph, { Pauli{ "XZI" }, Pauli{ "IZX" } });
+	REQUIRE(result.has_value());
+
+	auto layer = BinaryCliffordLayer::fromGates(*result);
+	REQUIRE(layer.toGates(3) == *result);
+	REQUIRE(layer.violations(Pauli{ "XZI" }, neighbours, 0b111) == 0);
+	REQUIRE(layer.violations(Pauli{ "XIX" }, neighbours, 0b111) == 0);
+	REQUIRE(layer.violations(Pauli{ "XII" }, neighbours, 0b111) != 0);
+}
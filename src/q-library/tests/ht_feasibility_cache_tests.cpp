@@ -0,0 +1,50 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "ht_feasibility_cache.h"
+
+
+using namespace Q;
+
+TEST_CASE("HTFeasibilityCache key") {
+	HTFeasibilityCache::Key a, b;
+	std::vector<std::array<uint64_t, 2>> rows;
+	std::vector<uint64_t> neighbours{ 0b0010, 0b0101, 0b0010, 0b0000 };
+
+	// Same span on the component {0,1,2}, different Paulis and different support outside
+	HTFeasibilityCache::makeKey(a, 0b0111, neighbours, { Pauli{ "XZII" }, Pauli{ "ZXZI" } }, rows);
+	HTFeasibilityCache::makeKey(b, 0b0111, neighbours, { Pauli{ "YYZX" }, Pauli{ "ZXZZ" }, Pauli{ "XZIY" } }, rows);
+	REQUIRE(a == b);
+
+	HTFeasibilityCache::makeKey(b, 0b0111, neighbours, { Pauli{ "XZII" } }, rows);
+	REQUIRE(a != b);
+	HTFeasibilityCache::makeKey(b, 0b0111, { 0b0110, 0b0101, 0b0011, 0 }, { Pauli{ "XZII" }, Pauli{ "ZXZI" } }, rows);
+	REQUIRE(a != b);
+}
+
+TEST_CASE("HTFeasibilityCache find and insert") {
+	HTFeasibilityCache cache;
+	HTFeasibilityCache::Key key{ 0b11, 0b10, 0b01, 1, 2 };
+	REQUIRE_FALSE(cache.find(key).has_value());
+
+	HTFeasibilityCache::Entry entry{ true, BinaryCliffordLayer::identity() };
+	cache.insert(key, entry);
+	auto found = cache.find(key);
+	REQUIRE(found.has_value());
+	REQUIRE(found->feasible);
+	REQUIRE(found->layer.a == entry.layer.a);
+	REQUIRE(cache.statistics().hits == 1);
+	REQUIRE(cache.statistics().misses == 1);
+}
+
+TEST_CASE("HTFeasibilityCache eviction") {
+	HTFeasibilityCache cache{ 64 * 1024 };
+	for (uint64_t i = 0; i < 10000; ++i) {
+		cache.insert({ i }, {});
+	}
+	REQUIRE(cache.statistics().evictions > 0);
+	REQUIRE(cache.size() < 10000);
+
+	HTFeasibilityCache disabled{ 0 };
+	disabled.insert({ 1 }, {});
+	REQUIRE(disabled.size() == 0);
+}
@@ -0,0 +1,81 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "ht_layer_tables.h"
+#include "native_ht_circuit_finder.h"
+#include <filesystem>
+#include <random>
+
+
+using namespace Q;
+
+namespace {
+	std::vector<uint64_t> adjacencyRows(const Graph<>& graph) {
+		std::vector<uint64_t> rows(graph.numVertices());
+		for (int i = 0; i < graph.numVertices(); ++i)
+			for (int k = 0; k < graph.numVertices(); ++k)
+				if (graph.hasEdge(i, k)) rows[i] |= (1ULL << k);
+		return rows;
+	}
+}
+
+
+TEST_CASE("HTLayerTables agrees with NativeHTCircuitFinder") {
+	std::mt19937_64 rng{ 7 };
+	HTLayerTables tables;
+	NativeHTCircuitFinder finder{ 6 };
+	const std::array<char, 4> c{ 'I', 'X', 'Y', 'Z' };
+
+	for (int trial = 0; trial < 500; ++trial) {
+		const int k = 1 + trial % HTLayerTables::maxVertices;
+		Graph<> graph{ 6 };
+		std::vector<int> vertices;
+		for (int i = 0; i < 6 && static_cast<int>(vertices.size()) < k; ++i) {
+			if (rng() % 3 || 6 - i == k - static_cast<int>(vertices.size())) vertices.push_back(i);
+		}
+		for (int i = 0; i < k; ++i)
+			for (int j = i + 1; j < k; ++j)
+				if (rng() & 1) graph.addEdge(vertices[i], vertices[j]);
+
+		std::vector<Pauli> paulis;
+		for (int attempt = 0; attempt < 8 && paulis.size() < 3; ++attempt) {
+			std::string s;
+			for (int i = 0; i < 6; ++i) s += c[rng() % 4];
+			Pauli pauli{ s };
+			if (std::ranges::all_of(paulis, [&](const auto& p) { return commutesLocally(p, pauli, ~0ULL); })) paulis.push_back(pauli);
+		}
+
+		auto layer = BinaryCliffordLayer::identity();
+		const bool feasible = tables.findLayer(paulis, vertices, adjacencyRows(graph), layer);
+		REQUIRE(feasible == finder.findHTCircuit(graph, paulis, vertices).has_value());
+		if (feasible) {
+			uint64_t support{};
+			for (int vertex : vertices) support |= 1ULL << vertex;
+			for (const auto& pauli : paulis) {
+				REQUIRE(layer.violations(pauli, adjacencyRows(graph), support) == 0);
+			}
+		}
+	}
+}
+
+TEST_CASE("HTLayerTables save and load") {
+	HTLayerTables tables;
+	auto graph = Graph<>::linear(4);
+	auto rows = adjacencyRows(graph);
+	BinaryCliffordLayer layer;
+	REQUIRE(tables.findLayer({ Pauli{ "XZII" }, Pauli{ "ZXZI" } }, { 0, 1, 2, 3 }, rows, layer));
+	REQUIRE_FALSE(tables.findLayer({ Pauli{ "XIII" } }, { 0, 1, 2, 3 }, rows, layer));
+	REQUIRE(tables.size() == 1);
+
+	const auto filename = (std::filesystem::temp_directory_path() / "ht_layer_tables_test.bin").string();
+	tables.save(filename);
+	HTLayerTables loaded;
+	loaded.load(filename);
+	std::filesystem::remove(filename);
+	REQUIRE(loaded.size() == 1);
+
+	BinaryCliffordLayer a, b;
+	REQUIRE(tables.findLayer({ Pauli{ "YYZI" } }, { 0, 1, 2, 3 }, rows, a));
+	REQUIRE(loaded.findLayer({ Pauli{ "YYZI" } }, { 0, 1, 2, 3 }, rows, b));
+	REQUIRE(a.toGates(4) == b.toGates(4));
+	REQUIRE(loaded.size() == 1);
+}
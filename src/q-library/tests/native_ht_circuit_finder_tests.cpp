@@ -0,0 +1,95 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "native_ht_circuit_finder.h"
+#include <random>
+
+
+using namespace Q;
+
+namespace {
+	constexpr std::array<BinaryCliffordGate, 6> gates{
+		BinaryCliffordGates::I, BinaryCliffordGates::H, BinaryCliffordGates::S,
+		BinaryCliffordGates::HS, BinaryCliffordGates::SH, BinaryCliffordGates::HSH
+	};
+
+	// Check that each transformed Pauli satisfies z'_i = ∑_{k ∈ N(i)} x'_k
+	bool diagonalizes(const Graph<>& graph, const std::vector<Pauli>& paulis, const std::vector<BinaryCliffordGate>& layer) {
+		const int n = graph.numVertices();
+		for (const auto& pauli : paulis) {
+			std::vector<int> x(n), z(n);
+			for (int k = 0; k < n; ++k) {
+				x[k] = (layer[k](0, 0).toInt() & pauli.x(k)) ^ (layer[k](0, 1).toInt() & pauli.z(k));
+				z[k] = (layer[k](1, 0).toInt() & pauli.x(k)) ^ (layer[k](1, 1).toInt() & pauli.z(k));
+			}
+			for (int i = 0; i < n; ++i) {
+				int sum = z[i];
+				for (int k = 0; k < n; ++k) if (graph.hasEdge(i, k)) sum ^= x[k];
+				if (sum) return false;
+			}
+		}
+		return true;
+	}
+
+	bool bruteForce(const Graph<>& graph, const std::vector<Pauli>& paulis) {
+		const int n = graph.numVertices();
+		std::vector<BinaryCliffordGate> layer(n);
+		int total = 1;
+		for (int i = 0; i < n; ++i) total *= 6;
+		for (int code = 0; code < total; ++code) {
+			for (int i = 0, c = code; i < n; ++i, c /= 6) layer[i] = gates[c % 6];
+			if (diagonalizes(graph, paulis, layer)) return true;
+		}
+		return false;
+	}
+}
+
+
+TEST_CASE("NativeHTCircuitFinder graph state stabilizer") {
+	NativeHTCircuitFinder finder{ 3 };
+	auto graph = Graph<>::linear(3);
+	std::vector<Pauli> paulis{ Pauli{ "XZI" }, Pauli{ "ZXZ" }, Pauli{ "IZX" } };
+	auto result = finder.findHTCircuit(graph, paulis);
+	REQUIRE(result.has_value());
+	REQUIRE(diagonalizes(graph, paulis, *result));
+
+	REQUIRE_FALSE(finder.findHTCircuit(Graph<>::linear(2), { Pauli{ "XI" } }).has_value());
+	REQUIRE(finder.findHTCircuit(Graph<>(2), { Pauli{ "XI" }, Pauli{ "XZ" } }).has_value());
+	REQUIRE_FALSE(finder.findHTCircuit(Graph<>(2), { Pauli{ "XI" }, Pauli{ "ZI" } }).has_value());
+}
+
+TEST_CASE("NativeHTCircuitFinder component") {
+	NativeHTCircuitFinder finder{ 5 };
+	Graph<> graph{ 5 };
+	graph.addPath({ 1, 3, 4 });
+	std::vector<Pauli> paulis{ Pauli{ "XXIZI" }, Pauli{ "ZZIXZ" } };
+	std::vector<int> component{ 1, 3, 4 };
+	auto result = finder.findHTCircuit(graph, paulis, component);
+	REQUIRE(result.has_value() == bruteForce(Graph<>::linear(3), { Pauli{ "XZI" }, Pauli{ "ZXZ" } }));
+}
+
+TEST_CASE("NativeHTCircuitFinder agrees with brute force") {
+	std::mt19937_64 rng{ 42 };
+	NativeHTCircuitFinder finder{ 4 };
+	const std::array<char, 4> c{ 'I', 'X', 'Y', 'Z' };
+
+	for (int trial = 0; trial < 300; ++trial) {
+		const int n = 2 + trial % 3;
+		Graph<> graph{ n };
+		for (int i = 0; i < n; ++i)
+			for (int j = i + 1; j < n; ++j)
+				if (rng() & 1) graph.addEdge(i, j);
+
+		// Random commuting set
+		std::vector<Pauli> paulis;
+		for (int attempt = 0; attempt < 8 && paulis.size() < 4; ++attempt) {
+			std::string s;
+			for (int i = 0; i < n; ++i) s += c[rng() % 4];
+			Pauli pauli{ s };
+			if (std::ranges::all_of(paulis, [&](const auto& p) { return commutator(p, pauli) == 0; })) paulis.push_back(pauli);
+		}
+
+		auto result = finder.findHTCircuit(graph, paulis);
+		REQUIRE(result.has_value() == bruteForce(graph, paulis));
+		if (result) REQUIRE(diagonalizes(graph, paulis, *result));
+	}
+}
@@ -0,0 +1,32 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "pauli_span.h"
+
+
+using namespace Q;
+
+TEST_CASE("PauliSpan") {
+	PauliSpan span;
+	REQUIRE(span.contains(Pauli{ "III" }));
+	REQUIRE(span.insert(Pauli{ "XXI" }));
+	REQUIRE(span.insert(Pauli{ "ZZI" }));
+	REQUIRE(span.rank() == 2);
+
+	REQUIRE(span.contains(Pauli{ "YYI" }));
+	REQUIRE(span.contains(Pauli{ "-YYI" }));
+	REQUIRE_FALSE(span.contains(Pauli{ "XII" }));
+	REQUIRE_FALSE(span.insert(Pauli{ "YYI" }));
+	REQUIRE(span.rank() == 2);
+
+	REQUIRE(span.insert(Pauli{ "IXX" }));
+	REQUIRE(span.contains(Pauli{ "XIX" }));
+	REQUIRE(span.contains(Pauli{ "YZX" }));
+	REQUIRE_FALSE(span.contains(Pauli{ "IZZ" }));
+}
+
+TEST_CASE("PauliSpan canonical basis") {
+	PauliSpan a, b;
+	for (auto p : { "XXI", "ZZI", "IXX" }) a.insert(Pauli{ p });
+	for (auto p : { "XIX", "YYI", "IXX" }) b.insert(Pauli{ p });
+	REQUIRE(a.basis() == b.basis());
+}
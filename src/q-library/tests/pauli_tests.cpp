@@ -16,4 +16,9 @@ TEST_CASE("commutesLocally") {
 	REQUIRE(commutesLocally(Pauli{ "XX" }, Pauli{ "YZ" }, 0b01) == false);
 
 	REQUIRE(commutesLocally(Pauli{ "XZXXIIX" }, Pauli{ "YIZZXYZ" }, 0b1000111) == false);
-}
\ No newline at end of file
+}
+TEST_CASE("FromBitstrings") {
+	REQUIRE(Pauli::FromBitstrings(3, 0b011, 0b110) == Pauli{ "XYZ" });
+	REQUIRE(Pauli::FromBitstrings(2, 0b11, 0b11) == Pauli{ "YY" });
+	REQUIRE(Pauli::FromBitstrings(2, 0, 0) == Pauli::Identity(2));
+}
@@ -0,0 +1,53 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+
+using namespace Q;
+
+
+TEST_CASE("ThreadPool parallelFor visits every index once") {
+	ThreadPool pool{ 4 };
+	REQUIRE(pool.size() == 4);
+
+	for (size_t count : { 0, 1, 7, 1000 }) {
+		std::vector<std::atomic_int> visits(count);
+		std::atomic_bool validWorkers{ true };
+		pool.parallelFor(count, 0, [&](int worker, size_t first, size_t last) {
+			if (worker < 0 || worker >= 4) validWorkers = false;
+			for (auto i = first; i < last; ++i) ++visits[i];
+			});
+		REQUIRE(validWorkers);
+		REQUIRE(std::ranges::all_of(visits, [](const auto& v) { return v.load() == 1; }));
+	}
+}
+
+TEST_CASE("ThreadPool reuse and uneven work") {
+	ThreadPool pool{ 3 };
+	for (int round = 0; round < 50; ++round) {
+		std::atomic<size_t> sum{};
+		pool.parallelFor(100, 1, [&](int, size_t first, size_t last) {
+			for (auto i = first; i < last; ++i) {
+				if (i < 10) std::this_thread::sleep_for(std::chrono::microseconds(100));
+				sum += i;
+			}
+			});
+		REQUIRE(sum == 4950);
+	}
+}
+
+TEST_CASE("ThreadPool rethrows exceptions") {
+	ThreadPool pool{ 2 };
+	REQUIRE_THROWS_AS(pool.parallelFor(10, 1, [](int, size_t first, size_t) {
+		if (first == 5) throw std::runtime_error("error");
+		}), std::runtime_error);
+
+	std::atomic_int count{};
+	pool.parallelFor(10, 1, [&](int, size_t, size_t) { ++count; });
+	REQUIRE(count == 10);
+}
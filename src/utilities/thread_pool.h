@@ -0,0 +1,153 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+namespace Q {
+
+	/// @brief Fixed set of worker threads that is created once and reused for many parallel loops.
+	///
+	/// Each call to parallelFor() splits the index range into chunks which are distributed over
+	/// per-worker deques in contiguous blocks. Workers take chunks from the back of their own deque
+	/// and steal from the front of the other deques once theirs is empty, so a worker that gets
+	/// the expensive chunks does not hold up the others. The caller blocks on a latch until all
+	/// workers are done.
+	class ThreadPool {
+	public:
+		/// @brief Function called with (worker index, first index, last index)
+		using Task = std::function<void(int, size_t, size_t)>;
+
+		explicit ThreadPool(int numThreads) : queues(std::max(numThreads, 1)) {
+			for (int i = 0; i < size(); ++i) {
+				workers.emplace_back([this, i] { run(i); });
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool() {
+			{
+				std::lock_guard lock{ mutex };
+				stop = true;
+			}
+			wakeUp.notify_all();
+			workers.clear(); // join before the synchronization primitives are destroyed
+		}
+
+		int size() const { return static_cast<int>(queues.size()); }
+
+		/// @brief Call task for all chunks of [0, count) and wait until all have been processed.
+		///        Exceptions thrown by the task are rethrown here (the first one wins).
+		/// @param count      Number of indices
+		/// @param chunkSize  Number of indices per chunk (0 picks a size that gives several chunks per worker)
+		/// @param task       Function called with (worker index, first index, last index)
+		void parallelFor(size_t count, size_t chunkSize, const Task& task) {
+			if (count == 0) return;
+			if (chunkSize == 0) chunkSize = std::max<size_t>(1, count / (8 * queues.size()));
+
+			const auto numChunks = (count + chunkSize - 1) / chunkSize;
+			const auto chunksPerWorker = (numChunks + queues.size() - 1) / queues.size();
+			for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+				auto& queue = queues[chunk / chunksPerWorker];
+				std::lock_guard lock{ queue.mutex };
+				// The owner pops from the back, so the chunks are pushed in reverse order
+				queue.ranges.push_front({ chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize) });
+			}
+
+			std::latch done{ size() };
+			{
+				std::lock_guard lock{ mutex };
+				currentTask = &task;
+				finished = &done;
+				error = nullptr;
+				++generation;
+			}
+			wakeUp.notify_all();
+			done.wait();
+
+			if (error) std::rethrow_exception(error);
+		}
+
+	private:
+		struct Range {
+			size_t first{};
+			size_t last{};
+		};
+
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Range> ranges;
+		};
+
+		std::vector<Queue> queues;
+		std::vector<std::jthread> workers;
+
+		std::mutex mutex;
+		std::condition_variable wakeUp;
+		uint64_t generation{};
+		bool stop{};
+		const Task* currentTask{};
+		std::latch* finished{};
+		std::exception_ptr error;
+
+		void run(int index) {
+			uint64_t seenGeneration{};
+			while (true) {
+				const Task* task;
+				std::latch* done;
+				{
+					std::unique_lock lock{ mutex };
+					wakeUp.wait(lock, [&] { return stop || generation != seenGeneration; });
+					if (stop) return;
+					seenGeneration = generation;
+					task = currentTask;
+					done = finished;
+				}
+				while (auto range = next(index)) {
+					try {
+						(*task)(index, range->first, range->last);
+					}
+					catch (...) {
+						std::lock_guard lock{ mutex };
+						if (!error) error = std::current_exception();
+					}
+				}
+				done->count_down();
+			}
+		}
+
+		std::optional<Range> next(int index) {
+			{
+				auto& own = queues[index];
+				std::lock_guard lock{ own.mutex };
+				if (!own.ranges.empty()) {
+					auto range = own.ranges.back();
+					own.ranges.pop_back();
+					return range;
+				}
+			}
+			for (int offset = 1; offset < size(); ++offset) {
+				auto& victim = queues[(index + offset) % size()];
+				std::lock_guard lock{ victim.mutex };
+				if (!victim.ranges.empty()) {
+					auto range = victim.ranges.front();
+					victim.ranges.pop_front();
+					return range;
+				}
+			}
+			return std::nullopt;
+		}
+	};
+
+}